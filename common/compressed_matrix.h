@@ -0,0 +1,241 @@
+#pragma once
+
+// Сжатая плотная матрица для умножения на вектор, когда оно упирается в пропускную
+// способность памяти (8 байт на 2 операции). Строки режутся на блоки по 64 элемента, каждый
+// блок хранится одним из способов и распаковывается прямо во внутреннем цикле умножения:
+//
+//   Linear - a[k] = base + k * step точно (матрица i + j): 16 байт на блок;
+//   Xor16, Xor32 - bits(a[k]) = bits(base) ^ (r[k] << shift), r по 16 или 32 бита: у близких
+//            по величине чисел совпадают знак, порядок и старшие биты мантиссы, а у целых
+//            и коротких дробей младшие биты нулевые;
+//   Raw    - 64 double как есть;
+//   Block16 - с потерей точности: общий множитель 2^e на блок и 16-битные мантиссы,
+//            относительная ошибка элемента не больше 2^-15 от наибольшего в блоке.
+//
+// Без потерь (Lossless) для каждого блока берется самый короткий из первых четырех способов,
+// с потерями (Block16) все блоки хранятся как Block16, кроме блоков с Inf или NaN: у них нет
+// общего множителя, они хранятся как Raw. Описатели блоков лежат отдельным
+// массивом по 8 байт, данные блоков - подряд, выровненные на 8 байт. 16- и 32-битные слова
+// и double внутри блока пишутся и читаются через memcpy: массив данных - uint64_t, и
+// обращение к нему через указатель другого типа нарушало бы strict aliasing.
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+#include <omp.h>
+
+enum class Compression { Lossless, Block16 };
+
+class CompressedMatrix {
+public:
+    static constexpr size_t BLOCK = 64;
+
+    enum BlockType : uint8_t { Linear, Xor16, Xor32, Raw, Block16 };
+
+    CompressedMatrix(const double* a, size_t n, size_t m, Compression mode) : n(n), m(m), blocks_per_row((m + BLOCK - 1) / BLOCK) {
+        info.resize(n * blocks_per_row);
+        // Строки сжимаются параллельно в свои буферы, затем склеиваются
+        std::vector<std::vector<uint64_t>> rows(n);
+        #pragma omp parallel for schedule(dynamic, 64)
+        for (size_t i = 0; i < n; ++i) {
+            for (size_t b = 0; b < blocks_per_row; ++b) {
+                size_t j0 = b * BLOCK, len = std::min(BLOCK, m - j0);
+                BlockInfo& bi = info[i * blocks_per_row + b];
+                bi.offset = static_cast<uint32_t>(rows[i].size());
+                bi.len = static_cast<uint16_t>(len);
+                if (mode == Compression::Block16)
+                    encode_block16(a + i * m + j0, len, bi, rows[i]);
+                else
+                    encode_lossless(a + i * m + j0, len, bi, rows[i]);
+            }
+        }
+        row_start.resize(n + 1);
+        for (size_t i = 0; i < n; ++i)
+            row_start[i + 1] = row_start[i] + rows[i].size();
+        data.resize(row_start[n]);
+        #pragma omp parallel for schedule(static)
+        for (size_t i = 0; i < n; ++i)
+            std::copy(rows[i].begin(), rows[i].end(), data.begin() + row_start[i]);
+    }
+
+    // y = A x
+    void gemv(const double* x, double* y) const {
+        #pragma omp parallel for schedule(static)
+        for (size_t i = 0; i < n; ++i) {
+            const uint64_t* row = data.data() + row_start[i];
+            const BlockInfo* bi = &info[i * blocks_per_row];
+            double sum = 0.0;
+            for (size_t b = 0; b < blocks_per_row; ++b)
+                sum += block_dot(bi[b], row + bi[b].offset, x + b * BLOCK);
+            y[i] = sum;
+        }
+    }
+
+    // Байт на матрицу вместе с описателями блоков и началами строк
+    size_t bytes() const {
+        return data.size() * sizeof(uint64_t) + info.size() * sizeof(BlockInfo) + row_start.size() * sizeof(size_t);
+    }
+    double ratio() const { return double(n) * m * sizeof(double) / bytes(); }
+
+    // Число блоков каждого типа
+    std::vector<size_t> block_counts() const {
+        std::vector<size_t> counts(5);
+        for (const BlockInfo& bi : info) ++counts[bi.type];
+        return counts;
+    }
+
+    static const char* block_type_name(int type) {
+        static const char* names[] = {"linear", "xor16", "xor32", "raw", "block16"};
+        return names[type];
+    }
+
+private:
+    struct BlockInfo {
+        uint32_t offset;  // в словах от начала строки
+        uint8_t type;
+        uint8_t shift;
+        uint16_t len;
+    };
+
+    static uint64_t bits(double v) { return std::bit_cast<uint64_t>(v); }
+
+    static void encode_lossless(const double* a, size_t len, BlockInfo& bi, std::vector<uint64_t>& out) {
+        double base = a[0];
+        // Linear: проверяется тем же выражением, что и при распаковке. Явный fma, чтобы
+        // результат не зависел от того, сольет ли компилятор умножение и сложение. Без
+        // -mfma (-march=native) std::fma - вызов libm, и Linear-блоки распаковываются медленно
+        double step = len > 1 ? a[1] - a[0] : 0.0;
+        bool linear = true;
+        for (size_t k = 0; k < len && linear; ++k)
+            linear = bits(std::fma(double(k), step, base)) == bits(a[k]);
+        if (linear) {
+            bi.type = Linear;
+            out.push_back(bits(base));
+            out.push_back(bits(step));
+            return;
+        }
+
+        uint64_t diff = 0;
+        for (size_t k = 0; k < len; ++k)
+            diff |= bits(a[k]) ^ bits(base);
+        int shift = diff ? std::countr_zero(diff) : 0;
+        int width = diff ? 64 - std::countl_zero(diff) - shift : 0;
+        if (width <= 32) {
+            bi.type = width <= 16 ? Xor16 : Xor32;
+            bi.shift = static_cast<uint8_t>(shift);
+            out.push_back(bits(base));
+            size_t word_bytes = width <= 16 ? 2 : 4;
+            size_t at = out.size();
+            out.resize(at + (len * word_bytes + 7) / 8, 0);
+            char* dst = reinterpret_cast<char*>(out.data() + at);
+            for (size_t k = 0; k < len; ++k) {
+                uint64_t r = (bits(a[k]) ^ bits(base)) >> shift;
+                if (word_bytes == 2) {
+                    uint16_t v = static_cast<uint16_t>(r);
+                    std::memcpy(dst + 2 * k, &v, 2);
+                } else {
+                    uint32_t v = static_cast<uint32_t>(r);
+                    std::memcpy(dst + 4 * k, &v, 4);
+                }
+            }
+            return;
+        }
+
+        bi.type = Raw;
+        for (size_t k = 0; k < len; ++k)
+            out.push_back(bits(a[k]));
+    }
+
+    static void encode_block16(const double* a, size_t len, BlockInfo& bi, std::vector<uint64_t>& out) {
+        double max_abs = 0.0;
+        bool finite = true;
+        for (size_t k = 0; k < len; ++k) {
+            finite = finite && std::isfinite(a[k]);
+            max_abs = std::max(max_abs, std::fabs(a[k]));
+        }
+        if (!finite) {
+            bi.type = Raw;
+            for (size_t k = 0; k < len; ++k)
+                out.push_back(bits(a[k]));
+            return;
+        }
+        bi.type = Block16;
+        // max_abs < 2^(e+1), так что a / scale по модулю меньше 2^15
+        double scale = max_abs > 0 ? std::ldexp(1.0, std::ilogb(max_abs) - 14) : 0.0;
+        out.push_back(bits(scale));
+        size_t at = out.size();
+        out.resize(at + (len * 2 + 7) / 8, 0);
+        char* dst = reinterpret_cast<char*>(out.data() + at);
+        for (size_t k = 0; k < len; ++k) {
+            double v = scale > 0 ? std::nearbyint(a[k] / scale) : 0.0;
+            int16_t q = static_cast<int16_t>(std::clamp(v, -32767.0, 32767.0));
+            std::memcpy(dst + 2 * k, &q, 2);
+        }
+    }
+
+    static double block_dot(const BlockInfo& bi, const uint64_t* p, const double* x) {
+        size_t len = bi.len;
+        double sum = 0.0;
+        switch (bi.type) {
+            case Linear: {
+                double base = std::bit_cast<double>(p[0]), step = std::bit_cast<double>(p[1]);
+                #pragma omp simd reduction(+:sum)
+                for (size_t k = 0; k < len; ++k)
+                    sum += std::fma(double(k), step, base) * x[k];
+                break;
+            }
+            case Xor16: {
+                uint64_t base = p[0];
+                unsigned shift = bi.shift;
+                const char* r = reinterpret_cast<const char*>(p + 1);
+                #pragma omp simd reduction(+:sum)
+                for (size_t k = 0; k < len; ++k) {
+                    uint16_t rk;
+                    std::memcpy(&rk, r + 2 * k, 2);
+                    sum += std::bit_cast<double>(base ^ (uint64_t(rk) << shift)) * x[k];
+                }
+                break;
+            }
+            case Xor32: {
+                uint64_t base = p[0];
+                unsigned shift = bi.shift;
+                const char* r = reinterpret_cast<const char*>(p + 1);
+                #pragma omp simd reduction(+:sum)
+                for (size_t k = 0; k < len; ++k) {
+                    uint32_t rk;
+                    std::memcpy(&rk, r + 4 * k, 4);
+                    sum += std::bit_cast<double>(base ^ (uint64_t(rk) << shift)) * x[k];
+                }
+                break;
+            }
+            case Raw: {
+                #pragma omp simd reduction(+:sum)
+                for (size_t k = 0; k < len; ++k)
+                    sum += std::bit_cast<double>(p[k]) * x[k];
+                break;
+            }
+            default: {
+                double scale = std::bit_cast<double>(p[0]);
+                const char* q = reinterpret_cast<const char*>(p + 1);
+                #pragma omp simd reduction(+:sum)
+                for (size_t k = 0; k < len; ++k) {
+                    int16_t qk;
+                    std::memcpy(&qk, q + 2 * k, 2);
+                    sum += double(qk) * x[k];
+                }
+                sum *= scale;
+                break;
+            }
+        }
+        return sum;
+    }
+
+    size_t n, m, blocks_per_row;
+    std::vector<BlockInfo> info;
+    std::vector<size_t> row_start;  // в словах
+    std::vector<uint64_t> data;
+};
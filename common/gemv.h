@@ -0,0 +1,194 @@
+#pragma once
+
+// Умножение плотной матрицы n x m (по строкам) на вектор с разбиением под форму матрицы.
+//
+// Потоки образуют решетку pr x pc: строки делятся на pr блоков, столбцы - на pc. При
+// достаточном числе строк pc = 1 и это обычное разбиение по строкам. Когда строк мало
+// (100 x 10^7), часть потоков при делении по строкам простаивала бы; тогда столбцы
+// делятся тоже, каждый поток считает частичные суммы своих строк в свой буфер, и буферы
+// потоков одного блока строк складываются деревом за log2(pc) шагов.
+//
+// choose_partition() перебирает делители числа потоков и берет решетку с наименьшей
+// оценкой: элементы самого большого блока плюс сложение частичных сумм.
+//
+// Транспонированное умножение y = A^T x (gemv_transposed) идет по той же матрице по строкам:
+// поток читает строки своего блока подряд и копит a[i][j] x[i] в собственном буфере столбцов,
+// обходя столбцы полосами по GEMV_T_TILE, чтобы буфер лежал в L1. Решетка та же, только
+// выход - столбцы, а суммирование - по строкам: choose_partition(m, n, threads). Буферы
+// потоков с общей полосой столбцов складываются поблочно: каждый из них суммирует свой
+// кусок полосы по всем буферам. gemv(trans, ...) выбирает одно из двух умножений.
+//
+// OpenMP может дать меньше потоков, чем просили (вложенный parallel, OMP_THREAD_LIMIT):
+// тогда поток берет блоки решетки t, t + nth, ..., и результат от числа потоков не зависит.
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <vector>
+#include <omp.h>
+
+struct GemvBlock {
+    size_t r0, r1, c0, c1;
+};
+
+struct GemvPartition {
+    int pr = 1, pc = 1;
+
+    int threads() const { return pr * pc; }
+
+    // Блок потока t: строки [r0, r1), столбцы [c0, c1)
+    GemvBlock block(int t, size_t n, size_t m) const {
+        int bi = t / pc, bj = t % pc;
+        return {split(n, pr, bi), split(n, pr, bi + 1), split(m, pc, bj), split(m, pc, bj + 1)};
+    }
+
+    static size_t split(size_t len, int parts, int k) {
+        return len / parts * k + std::min<size_t>(k, len % parts);
+    }
+};
+
+// Строк на поток меньше этого - блок слишком мелкий, чтобы не делить столбцы
+constexpr size_t GEMV_MIN_ROWS_PER_THREAD = 16;
+
+inline GemvPartition choose_partition(size_t n, size_t m, int threads) {
+    if (n >= GEMV_MIN_ROWS_PER_THREAD * threads || m < 2)
+        return {threads, 1};
+    GemvPartition best{threads, 1};
+    double best_cost = -1.0;
+    for (int pr = 1; pr <= threads; ++pr) {
+        if (threads % pr != 0) continue;
+        int pc = threads / pr;
+        double rows = std::ceil(double(n) / pr), cols = std::ceil(double(m) / pc);
+        // Сложение частичных сумм: log2(pc) проходов по блоку строк, каждый дороже
+        // умножения на элемент примерно вдвое (чтение двух буферов и запись)
+        double cost = rows * cols + (pc > 1 ? 2.0 * rows * std::ceil(std::log2(pc)) : 0.0);
+        if (best_cost < 0 || cost < best_cost) {
+            best_cost = cost;
+            best = {pr, pc};
+        }
+    }
+    return best;
+}
+
+// y = A x с заданным разбиением; просится part.threads() потоков
+inline void gemv_partitioned(const double* a, const double* x, double* y, size_t n, size_t m, GemvPartition part) {
+    std::vector<std::vector<double>> partial(part.pc > 1 ? part.threads() : 0);
+    #pragma omp parallel num_threads(part.threads())
+    {
+        int tid = omp_get_thread_num(), nth = omp_get_num_threads();
+        for (int t = tid; t < part.threads(); t += nth) {
+            GemvBlock blk = part.block(t, n, m);
+            double* out = y + blk.r0;
+            if (part.pc > 1) {
+                partial[t].resize(blk.r1 - blk.r0);
+                out = partial[t].data();
+            }
+            for (size_t i = blk.r0; i < blk.r1; ++i) {
+                const double* row = a + i * m;
+                double sum = 0.0;
+                #pragma omp simd reduction(+:sum)
+                for (size_t j = blk.c0; j < blk.c1; ++j)
+                    sum += row[j] * x[j];
+                out[i - blk.r0] = sum;
+            }
+        }
+
+        if (part.pc > 1) {
+            // Дерево по столбцам решетки: на шаге s блок bj прибавляет буфер bj + s
+            for (int s = 1; s < part.pc; s *= 2) {
+                #pragma omp barrier
+                for (int t = tid; t < part.threads(); t += nth) {
+                    int bj = t % part.pc;
+                    if (bj % (2 * s) == 0 && bj + s < part.pc) {
+                        double* dst = partial[t].data();
+                        const double* src = partial[t + s].data();
+                        size_t len = partial[t].size();
+                        #pragma omp simd
+                        for (size_t i = 0; i < len; ++i)
+                            dst[i] += src[i];
+                    }
+                }
+            }
+            for (int t = tid; t < part.threads(); t += nth)
+                if (t % part.pc == 0)
+                    std::copy(partial[t].begin(), partial[t].end(), y + part.block(t, n, m).r0);
+        }
+    }
+}
+
+inline void gemv_partitioned(const double* a, const double* x, double* y, size_t n, size_t m, int threads) {
+    gemv_partitioned(a, x, y, n, m, choose_partition(n, m, threads));
+}
+
+// Ширина полосы столбцов в транспонированном умножении: 2048 * 8 = 16 КБ буфера
+constexpr size_t GEMV_T_TILE = 2048;
+
+// y = A^T x: x длины n, y длины m. part.pr делит столбцы (выход), part.pc - строки
+inline void gemv_transposed(const double* a, const double* x, double* y, size_t n, size_t m, GemvPartition part) {
+    std::vector<std::vector<double>> partial(part.threads());
+    #pragma omp parallel num_threads(part.threads())
+    {
+        int tid = omp_get_thread_num(), nth = omp_get_num_threads();
+        for (int t = tid; t < part.threads(); t += nth) {
+            GemvBlock out = part.block(t, m, n);  // r - столбцы A, c - строки A
+            size_t c0 = out.r0, c1 = out.r1, i0 = out.c0, i1 = out.c1;
+            std::vector<double>& acc_buf = partial[t];
+            acc_buf.assign(c1 - c0, 0.0);
+            double* acc = acc_buf.data();  // acc[j - c0] для j из [c0, c1)
+
+            for (size_t j0 = c0; j0 < c1; j0 += GEMV_T_TILE) {
+                size_t j1 = std::min(c1, j0 + GEMV_T_TILE);
+                size_t i = i0;
+                for (; i + 4 <= i1; i += 4) {
+                    const double *r0 = a + i * m, *r1 = r0 + m, *r2 = r1 + m, *r3 = r2 + m;
+                    double x0 = x[i], x1 = x[i + 1], x2 = x[i + 2], x3 = x[i + 3];
+                    #pragma omp simd
+                    for (size_t j = j0; j < j1; ++j)
+                        acc[j - c0] += r0[j] * x0 + r1[j] * x1 + r2[j] * x2 + r3[j] * x3;
+                }
+                for (; i < i1; ++i) {
+                    const double* row = a + i * m;
+                    double xi = x[i];
+                    #pragma omp simd
+                    for (size_t j = j0; j < j1; ++j)
+                        acc[j - c0] += row[j] * xi;
+                }
+            }
+            if (part.pc == 1)
+                std::copy(acc_buf.begin(), acc_buf.end(), y + c0);
+        }
+
+        if (part.pc > 1) {
+            // Блок br из pc блоков полосы складывает свой кусок полосы по всем их буферам
+            #pragma omp barrier
+            for (int t = tid; t < part.threads(); t += nth) {
+                GemvBlock out = part.block(t, m, n);
+                size_t c0 = out.r0, len = out.r1 - out.r0;
+                int bo = t / part.pc, br = t % part.pc;
+                size_t k0 = GemvPartition::split(len, part.pc, br), k1 = GemvPartition::split(len, part.pc, br + 1);
+                for (size_t k = k0; k < k1; ++k) {
+                    double sum = 0.0;
+                    for (int q = 0; q < part.pc; ++q)
+                        sum += partial[bo * part.pc + q][k];
+                    y[c0 + k] = sum;
+                }
+            }
+        }
+    }
+}
+
+inline void gemv_transposed(const double* a, const double* x, double* y, size_t n, size_t m, int threads) {
+    gemv_transposed(a, x, y, n, m, choose_partition(m, n, threads));
+}
+
+enum class Trans { No, Yes };
+
+// No: y = A x (x длины m, y длины n); Yes: y = A^T x (x длины n, y длины m).
+// A - n x m по строкам
+inline void gemv(Trans trans, const double* a, const double* x, double* y, size_t n, size_t m,
+                 int threads = omp_get_max_threads()) {
+    if (trans == Trans::No)
+        gemv_partitioned(a, x, y, n, m, threads);
+    else
+        gemv_transposed(a, x, y, n, m, threads);
+}
@@ -0,0 +1,390 @@
+#pragma once
+
+// Двоичный файл матрицы или вектора, который открывается через mmap без разбора и копирования.
+//
+//   [заголовок 4 КБ][секция 0][секция 1][секция 2]
+//
+// Заголовок: версия, вид (плотная матрица, разреженная CSR, вектор), раскладка, размеры,
+// число ненулевых и до трех секций со своим типом элементов, смещением и контрольной суммой.
+// Секции выровнены на 64 байта, хвосты заполнены нулями:
+//   Dense  - values (rows * cols, по строкам или по столбцам);
+//   Vector - values (rows);
+//   Sparse - row_ptr (int64, rows + 1), col_idx (int32 или int64, nnz), values (nnz).
+//
+// MatrixFileWriter отображает файл в память, секции заполняются прямо в нем потоками OpenMP,
+// контрольные суммы считаются параллельно при close(). Заголовок пишется последним, так что
+// недописанный файл не откроется. Контрольная сумма считается кусками по 1 МБ и не зависит
+// от числа потоков.
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <initializer_list>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <omp.h>
+
+enum class MatrixKind : uint32_t { Dense = 1, Sparse = 2, Vector = 3 };
+enum class MatrixLayout : uint32_t { RowMajor = 1, ColMajor = 2, Csr = 3 };
+enum class DType : uint32_t { F32 = 1, F64 = 2, I32 = 3, I64 = 4 };
+
+template <typename T>
+constexpr DType dtype_of() {
+    if constexpr (std::is_same_v<T, float>) return DType::F32;
+    else if constexpr (std::is_same_v<T, double>) return DType::F64;
+    else if constexpr (std::is_same_v<T, int32_t>) return DType::I32;
+    else {
+        static_assert(std::is_same_v<T, int64_t>, "Unsupported element type");
+        return DType::I64;
+    }
+}
+
+inline size_t dtype_size(DType dtype) {
+    switch (dtype) {
+        case DType::F32: case DType::I32: return 4;
+        case DType::F64: case DType::I64: return 8;
+        default: throw std::runtime_error("Unknown element type");
+    }
+}
+
+inline const char* dtype_name(DType dtype) {
+    switch (dtype) {
+        case DType::F32: return "f32";
+        case DType::F64: return "f64";
+        case DType::I32: return "i32";
+        case DType::I64: return "i64";
+        default: return "?";
+    }
+}
+
+inline const char* matrix_kind_name(MatrixKind kind) {
+    switch (kind) {
+        case MatrixKind::Dense: return "dense";
+        case MatrixKind::Sparse: return "sparse";
+        case MatrixKind::Vector: return "vector";
+        default: return "?";
+    }
+}
+
+constexpr char MATRIX_MAGIC[8] = {'D', 'Z', 'M', 'A', 'T', 'R', 'X', '\0'};
+constexpr uint32_t MATRIX_VERSION = 1;
+constexpr size_t MATRIX_HEADER_BYTES = 4096;
+constexpr size_t MATRIX_SECTION_ALIGN = 64;
+constexpr size_t MATRIX_MAX_SECTIONS = 3;
+constexpr size_t CHECKSUM_CHUNK = 1 << 20;
+
+struct MatrixSection {
+    uint64_t offset;
+    uint64_t count;  // элементов
+    uint32_t dtype;
+    uint32_t reserved;
+    uint64_t checksum;
+};
+
+struct MatrixFileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t header_bytes;
+    uint32_t kind;
+    uint32_t layout;
+    uint64_t rows, cols, nnz;
+    uint32_t sections;
+    uint32_t reserved;
+    MatrixSection section[MATRIX_MAX_SECTIONS];
+};
+
+// 64-битная сумма куска: четыре независимые цепочки умножений, чтобы не упираться в задержку
+inline uint64_t checksum_chunk(const unsigned char* data, size_t bytes) {
+    constexpr uint64_t P1 = 0x9E3779B185EBCA87ull, P2 = 0xC2B2AE3D27D4EB4Full;
+    uint64_t lane[4] = {P1, P2, P1 ^ P2, P1 + P2};
+    size_t words = bytes / 8;
+    size_t k = 0;
+    for (; k + 4 <= words; k += 4) {
+        for (int l = 0; l < 4; ++l) {
+            uint64_t w;
+            std::memcpy(&w, data + (k + l) * 8, 8);
+            lane[l] = ((lane[l] ^ w) * P1) ^ (lane[l] >> 29);
+        }
+    }
+    for (; k < words; ++k) {
+        uint64_t w;
+        std::memcpy(&w, data + k * 8, 8);
+        lane[k % 4] = ((lane[k % 4] ^ w) * P1) ^ (lane[k % 4] >> 29);
+    }
+    uint64_t tail = 0;
+    std::memcpy(&tail, data + k * 8, bytes - k * 8);
+    uint64_t h = bytes * P2 ^ tail;
+    for (uint64_t v : lane)
+        h = ((h ^ v) * P2) ^ (h >> 31);
+    return h;
+}
+
+inline uint64_t checksum(const void* data, size_t bytes) {
+    const unsigned char* p = static_cast<const unsigned char*>(data);
+    size_t chunks = (bytes + CHECKSUM_CHUNK - 1) / CHECKSUM_CHUNK;
+    std::vector<uint64_t> parts(chunks);
+    #pragma omp parallel for schedule(dynamic, 4)
+    for (size_t c = 0; c < chunks; ++c) {
+        size_t begin = c * CHECKSUM_CHUNK;
+        parts[c] = checksum_chunk(p + begin, std::min(CHECKSUM_CHUNK, bytes - begin));
+    }
+    uint64_t h = bytes;
+    for (uint64_t part : parts)
+        h = (h ^ part) * 0x9E3779B185EBCA87ull + (h >> 27);
+    return h;
+}
+
+struct SectionSpec {
+    DType dtype;
+    uint64_t count;
+};
+
+class MatrixFileWriter {
+public:
+    MatrixFileWriter(const std::string& path, MatrixKind kind, MatrixLayout layout, uint64_t rows, uint64_t cols,
+                     uint64_t nnz, std::initializer_list<SectionSpec> sections)
+        : path(path) {
+        if (sections.size() == 0 || sections.size() > MATRIX_MAX_SECTIONS)
+            throw std::runtime_error("Bad section count");
+        header = {};
+        std::memcpy(header.magic, MATRIX_MAGIC, sizeof(MATRIX_MAGIC));
+        header.version = MATRIX_VERSION;
+        header.header_bytes = MATRIX_HEADER_BYTES;
+        header.kind = static_cast<uint32_t>(kind);
+        header.layout = static_cast<uint32_t>(layout);
+        header.rows = rows;
+        header.cols = cols;
+        header.nnz = nnz;
+        header.sections = static_cast<uint32_t>(sections.size());
+        uint64_t offset = MATRIX_HEADER_BYTES;
+        size_t k = 0;
+        for (const SectionSpec& s : sections) {
+            header.section[k++] = {offset, s.count, static_cast<uint32_t>(s.dtype), 0, 0};
+            offset += align(s.count * dtype_size(s.dtype));
+        }
+        bytes = offset;
+
+        fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0)
+            throw std::runtime_error("Cannot create file: " + path);
+        if (ftruncate(fd, static_cast<off_t>(bytes)) != 0) {
+            ::close(fd);
+            throw std::runtime_error("Cannot resize file: " + path);
+        }
+        void* p = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (p == MAP_FAILED) {
+            ::close(fd);
+            throw std::runtime_error("Cannot map file: " + path);
+        }
+        base = static_cast<char*>(p);
+    }
+
+    ~MatrixFileWriter() {
+        if (base) {
+            munmap(base, bytes);
+            ::close(fd);
+        }
+    }
+
+    MatrixFileWriter(const MatrixFileWriter&) = delete;
+    MatrixFileWriter& operator=(const MatrixFileWriter&) = delete;
+
+    template <typename T>
+    T* section(size_t k) {
+        if (k >= header.sections || header.section[k].dtype != static_cast<uint32_t>(dtype_of<T>()))
+            throw std::runtime_error("Section type mismatch");
+        return reinterpret_cast<T*>(base + header.section[k].offset);
+    }
+
+    uint64_t section_count(size_t k) const { return header.section[k].count; }
+
+    // Контрольные суммы, заголовок, сброс на диск
+    void close() {
+        for (size_t k = 0; k < header.sections; ++k) {
+            MatrixSection& s = header.section[k];
+            s.checksum = checksum(base + s.offset, s.count * dtype_size(static_cast<DType>(s.dtype)));
+        }
+        std::memcpy(base, &header, sizeof(header));
+        if (msync(base, bytes, MS_SYNC) != 0)
+            throw std::runtime_error("Cannot flush file: " + path);
+        munmap(base, bytes);
+        ::close(fd);
+        base = nullptr;
+    }
+
+private:
+    static uint64_t align(uint64_t n) { return (n + MATRIX_SECTION_ALIGN - 1) / MATRIX_SECTION_ALIGN * MATRIX_SECTION_ALIGN; }
+
+    std::string path;
+    MatrixFileHeader header;
+    uint64_t bytes = 0;
+    int fd = -1;
+    char* base = nullptr;
+};
+
+// fn(i, j) - значение элемента, файл заполняется параллельно по строкам (или столбцам)
+template <typename T, typename Fn>
+void write_dense(const std::string& path, uint64_t rows, uint64_t cols, Fn fn,
+                 MatrixLayout layout = MatrixLayout::RowMajor) {
+    MatrixFileWriter w(path, MatrixKind::Dense, layout, rows, cols, rows * cols, {{dtype_of<T>(), rows * cols}});
+    T* a = w.section<T>(0);
+    bool row_major = layout == MatrixLayout::RowMajor;
+    int64_t outer = static_cast<int64_t>(row_major ? rows : cols);
+    uint64_t inner = row_major ? cols : rows;
+    #pragma omp parallel for schedule(static)
+    for (int64_t o = 0; o < outer; ++o)
+        for (uint64_t k = 0; k < inner; ++k)
+            a[o * inner + k] = row_major ? fn(o, k) : fn(k, o);
+    w.close();
+}
+
+template <typename T, typename Fn>
+void write_vector(const std::string& path, uint64_t n, Fn fn) {
+    MatrixFileWriter w(path, MatrixKind::Vector, MatrixLayout::RowMajor, n, 1, n, {{dtype_of<T>(), n}});
+    T* v = w.section<T>(0);
+    #pragma omp parallel for schedule(static)
+    for (int64_t i = 0; i < static_cast<int64_t>(n); ++i)
+        v[i] = fn(i);
+    w.close();
+}
+
+template <typename T, typename Index>
+void write_csr(const std::string& path, uint64_t rows, uint64_t cols, const std::vector<int64_t>& row_ptr,
+               const std::vector<Index>& col_idx, const std::vector<T>& values) {
+    uint64_t nnz = values.size();
+    if (row_ptr.size() != rows + 1 || col_idx.size() != nnz || static_cast<uint64_t>(row_ptr.back()) != nnz)
+        throw std::runtime_error("Inconsistent CSR arrays");
+    MatrixFileWriter w(path, MatrixKind::Sparse, MatrixLayout::Csr, rows, cols, nnz,
+                       {{DType::I64, rows + 1}, {dtype_of<Index>(), nnz}, {dtype_of<T>(), nnz}});
+    int64_t* rp = w.section<int64_t>(0);
+    Index* ci = w.section<Index>(1);
+    T* val = w.section<T>(2);
+    #pragma omp parallel
+    {
+        #pragma omp for schedule(static) nowait
+        for (int64_t i = 0; i <= static_cast<int64_t>(rows); ++i)
+            rp[i] = row_ptr[i];
+        #pragma omp for schedule(static)
+        for (int64_t k = 0; k < static_cast<int64_t>(nnz); ++k) {
+            ci[k] = col_idx[k];
+            val[k] = values[k];
+        }
+    }
+    w.close();
+}
+
+// Файл, отображенный только для чтения; данные читаются прямо из страничного кэша
+class MappedMatrix {
+public:
+    explicit MappedMatrix(const std::string& path, bool verify_checksums = false) : path(path) {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            throw std::runtime_error("Cannot open file: " + path);
+        struct stat st;
+        if (fstat(fd, &st) != 0) {
+            ::close(fd);
+            throw std::runtime_error("Cannot stat file: " + path);
+        }
+        bytes = static_cast<uint64_t>(st.st_size);
+        if (bytes < MATRIX_HEADER_BYTES) {
+            ::close(fd);
+            throw std::runtime_error("Not a matrix file: " + path);
+        }
+        void* p = mmap(nullptr, bytes, PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (p == MAP_FAILED)
+            throw std::runtime_error("Cannot map file: " + path);
+        base = static_cast<const char*>(p);
+        std::memcpy(&header, base, sizeof(header));
+        try {
+            validate();
+            if (verify_checksums) verify();
+        } catch (...) {
+            munmap(const_cast<char*>(base), bytes);
+            throw;
+        }
+    }
+
+    ~MappedMatrix() { munmap(const_cast<char*>(base), bytes); }
+
+    MappedMatrix(const MappedMatrix&) = delete;
+    MappedMatrix& operator=(const MappedMatrix&) = delete;
+
+    MatrixKind kind() const { return static_cast<MatrixKind>(header.kind); }
+    MatrixLayout layout() const { return static_cast<MatrixLayout>(header.layout); }
+    uint64_t rows() const { return header.rows; }
+    uint64_t cols() const { return header.cols; }
+    uint64_t nnz() const { return header.nnz; }
+    uint64_t file_bytes() const { return bytes; }
+    size_t sections() const { return header.sections; }
+    DType section_dtype(size_t k) const { return static_cast<DType>(header.section[k].dtype); }
+    uint64_t section_count(size_t k) const { return header.section[k].count; }
+
+    template <typename T>
+    const T* section(size_t k) const {
+        if (k >= header.sections || section_dtype(k) != dtype_of<T>())
+            throw std::runtime_error("Section type mismatch in " + path);
+        return reinterpret_cast<const T*>(base + header.section[k].offset);
+    }
+
+    // Dense и Vector: значения; Sparse: значения ненулевых
+    template <typename T>
+    const T* values() const { return section<T>(kind() == MatrixKind::Sparse ? 2 : 0); }
+    const int64_t* row_ptr() const { return section<int64_t>(0); }
+    template <typename Index>
+    const Index* col_idx() const { return section<Index>(1); }
+
+    void verify() const {
+        for (size_t k = 0; k < header.sections; ++k) {
+            const MatrixSection& s = header.section[k];
+            if (checksum(base + s.offset, s.count * dtype_size(section_dtype(k))) != s.checksum)
+                throw std::runtime_error("Checksum mismatch in section " + std::to_string(k) + " of " + path);
+        }
+    }
+
+    // Подсказка ядру прочитать файл заранее
+    void prefetch() const { madvise(const_cast<char*>(base), bytes, MADV_WILLNEED); }
+
+private:
+    void validate() const {
+        if (std::memcmp(header.magic, MATRIX_MAGIC, sizeof(MATRIX_MAGIC)) != 0)
+            throw std::runtime_error("Not a matrix file: " + path);
+        if (header.version != MATRIX_VERSION)
+            throw std::runtime_error("Unsupported matrix file version " + std::to_string(header.version));
+        if (header.sections == 0 || header.sections > MATRIX_MAX_SECTIONS)
+            throw std::runtime_error("Bad section count in " + path);
+        // Произведения считаются с проверкой переполнения: иначе испорченный заголовок
+        // с огромным count прошел бы проверку границ
+        for (size_t k = 0; k < header.sections; ++k) {
+            const MatrixSection& s = header.section[k];
+            uint64_t size;
+            if (__builtin_mul_overflow(s.count, uint64_t(dtype_size(section_dtype(k))), &size)
+                || s.offset % MATRIX_SECTION_ALIGN != 0 || s.offset < MATRIX_HEADER_BYTES || s.offset > bytes
+                || size > bytes - s.offset)
+                throw std::runtime_error("Section " + std::to_string(k) + " is out of file bounds in " + path);
+        }
+        size_t data_section = kind() == MatrixKind::Sparse ? 2 : 0;
+        uint64_t expected = header.nnz;
+        if (kind() == MatrixKind::Sparse) {
+            if (header.sections != 3 || header.rows == UINT64_MAX || section_count(0) != header.rows + 1)
+                throw std::runtime_error("Bad CSR sections in " + path);
+        } else if (__builtin_mul_overflow(header.rows, header.cols, &expected)) {
+            throw std::runtime_error("Shape overflows in " + path);
+        }
+        if (section_count(data_section) != expected)
+            throw std::runtime_error("Shape does not match data size in " + path);
+    }
+
+    std::string path;
+    const char* base = nullptr;
+    uint64_t bytes = 0;
+    MatrixFileHeader header;
+};
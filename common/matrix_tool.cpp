@@ -0,0 +1,88 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <omp.h>
+
+#include "matrix_file.h"
+
+// Создание входных данных заданий в двоичном формате matrix_file.h и просмотр файлов.
+//
+// g++ -std=c++20 -O3 -fopenmp matrix_tool.cpp -o matrix_tool
+// ./matrix_tool dz2.1 A.dzm b.dzm n [m]       a[i][j] = i + j, b[j] = j
+// ./matrix_tool dz2.3 A.dzm b.dzm n           2 на диагонали, 1 вне ее, b = n + 1
+// ./matrix_tool banded A.dzm b.dzm n w        CSR: ленточная матрица полуширины w, решение - единицы
+// ./matrix_tool info file [--verify]
+
+void print_info(const std::string& path, bool verify) {
+    double t = omp_get_wtime();
+    MappedMatrix file(path);
+    double open_time = omp_get_wtime() - t;
+    std::cout << path << ": " << matrix_kind_name(file.kind()) << " " << file.rows() << "x" << file.cols()
+              << ", nnz " << file.nnz() << ", " << file.file_bytes() / 1e6 << " MB, opened in "
+              << open_time * 1e3 << " ms\n";
+    for (size_t k = 0; k < file.sections(); ++k)
+        std::cout << "  section " << k << ": " << file.section_count(k) << " x " << dtype_name(file.section_dtype(k))
+                  << "\n";
+    if (verify) {
+        t = omp_get_wtime();
+        file.verify();
+        t = omp_get_wtime() - t;
+        std::cout << "  checksums ok, " << file.file_bytes() / t / 1e9 << " GB/s\n";
+    }
+}
+
+int main(int argc, char** argv) {
+    if (argc < 3) {
+        std::cerr << "Usage: " << argv[0] << " dz2.1|dz2.3|banded <A> <b> <n> [m|w] | info <file> [--verify]\n";
+        return 1;
+    }
+    try {
+        std::string mode = argv[1];
+        if (mode == "info") {
+            print_info(argv[2], argc > 3 && std::string(argv[3]) == "--verify");
+            return 0;
+        }
+        if (argc < 5) {
+            std::cerr << "Missing size\n";
+            return 1;
+        }
+        std::string a_path = argv[2], b_path = argv[3];
+        int64_t n = std::atoll(argv[4]);
+        double t = omp_get_wtime();
+        if (mode == "dz2.1") {
+            int64_t m = argc > 5 ? std::atoll(argv[5]) : n;
+            write_dense<double>(a_path, n, m, [](int64_t i, int64_t j) { return double(i + j); });
+            write_vector<double>(b_path, m, [](int64_t j) { return double(j); });
+        } else if (mode == "dz2.3") {
+            write_dense<double>(a_path, n, n, [](int64_t i, int64_t j) { return i == j ? 2.0 : 1.0; });
+            write_vector<double>(b_path, n, [n](int64_t) { return double(n + 1); });
+        } else if (mode == "banded") {
+            int64_t w = argc > 5 ? std::atoll(argv[5]) : 1;
+            std::vector<int64_t> row_ptr{0};
+            std::vector<int32_t> col_idx;
+            std::vector<double> values;
+            std::vector<double> row_sums(n);
+            for (int64_t i = 0; i < n; ++i) {
+                for (int64_t j = std::max<int64_t>(0, i - w); j <= std::min(n - 1, i + w); ++j) {
+                    col_idx.push_back(static_cast<int32_t>(j));
+                    values.push_back(i == j ? 2.0 * w + 1 : 1.0);
+                    row_sums[i] += values.back();
+                }
+                row_ptr.push_back(static_cast<int64_t>(values.size()));
+            }
+            write_csr(a_path, n, n, row_ptr, col_idx, values);
+            write_vector<double>(b_path, n, [&](int64_t i) { return row_sums[i]; });
+        } else {
+            std::cerr << "Unknown mode: " << mode << "\n";
+            return 1;
+        }
+        std::cout << "written in " << omp_get_wtime() - t << " s\n";
+        print_info(a_path, false);
+        print_info(b_path, false);
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << '\n';
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,203 @@
+#pragma once
+
+// Распределенное умножение матрицы на вектор y = A x на MPI, внутри процесса - OpenMP.
+//
+// Процессы образуют решетку pr x pc (pc = 1 - обычное разбиение по блокам строк).
+// Индексы вектора длины len делятся на pr блоков, каждый блок - на pc кусков; кусок (i, j)
+// принадлежит процессу i * pc + j. По номерам процессов куски идут подряд, так что для
+// вызывающего кода это обычное одномерное блочное распределение: у каждого процесса свой
+// непрерывный отрезок x и свой отрезок y.
+//
+// Процесс (i, j) хранит строки блока i и столбцы, которые принадлежат процессам столбца
+// решетки j (объединение кусков (i', j) по всем i'). Умножение:
+//   1. allgatherv кусков x внутри столбца решетки - нужная процессу часть x
+//      (при pc = 1 это allgather всего вектора);
+//   2. локальное умножение блока, строки делятся между потоками OpenMP;
+//   3. при pc > 1 частичные суммы складываются reduce_scatter внутри строки решетки,
+//      и каждый процесс получает свой кусок y.
+// Двумерная решетка нужна при большом числе процессов: каждый процесс собирает m / pc
+// элементов x вместо m.
+//
+// Вся матрица нигде целиком не хранится, каждый процесс заполняет свой блок через fill().
+
+#include <mpi.h>
+#include <omp.h>
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <vector>
+
+#include "trace.h"
+
+// Размеры кусков вектора длины len на решетке pr x pc
+struct VectorPartition {
+    int pr = 1, pc = 1;
+    std::vector<int> counts;  // по номерам процессов
+    std::vector<int> displs;
+
+    VectorPartition() = default;
+
+    VectorPartition(long len, int pr, int pc) : pr(pr), pc(pc), counts(pr * pc), displs(pr * pc) {
+        long offset = 0;
+        for (int i = 0; i < pr; ++i) {
+            long block = len / pr + (i < len % pr ? 1 : 0);
+            for (int j = 0; j < pc; ++j) {
+                long piece = block / pc + (j < block % pc ? 1 : 0);
+                counts[i * pc + j] = static_cast<int>(piece);
+                displs[i * pc + j] = static_cast<int>(offset);
+                offset += piece;
+            }
+        }
+    }
+
+    int count(int i, int j) const { return counts[i * pc + j]; }
+    int displ(int i, int j) const { return displs[i * pc + j]; }
+
+    // Суммарная длина блока строк i
+    int block(int i) const {
+        int sum = 0;
+        for (int j = 0; j < pc; ++j) sum += count(i, j);
+        return sum;
+    }
+};
+
+class DistributedMatrix {
+public:
+    // grid_cols = 1 - разбиение по блокам строк; 0 - решетку выбирает MPI_Dims_create
+    DistributedMatrix(long n, long m, MPI_Comm comm = MPI_COMM_WORLD, int grid_cols = 1)
+        : n(n), m(m), comm(comm) {
+        if (n > INT32_MAX || m > INT32_MAX)
+            throw std::runtime_error("Matrix dimension does not fit MPI counts");
+        MPI_Comm_rank(comm, &rank);
+        MPI_Comm_size(comm, &nprocs);
+        int dims[2] = {0, grid_cols};
+        if (grid_cols < 0)
+            throw std::runtime_error("Grid columns must be non-negative");
+        if (grid_cols > 0 && nprocs % grid_cols != 0)
+            throw std::runtime_error("Process count is not divisible by grid columns");
+        MPI_Dims_create(nprocs, 2, dims);
+        pr = dims[0];
+        pc = dims[1];
+        gi = rank / pc;
+        gj = rank % pc;
+        MPI_Comm_split(comm, gi, gj, &row_comm);
+        MPI_Comm_split(comm, gj, gi, &col_comm);
+
+        rows_part = VectorPartition(n, pr, pc);
+        cols_part = VectorPartition(m, pr, pc);
+        local_rows = rows_part.block(gi);
+        row_begin = rows_part.displ(gi, 0);
+
+        // Столбцы процесса: куски (i', gj) по порядку i'
+        for (int i = 0; i < pr; ++i) {
+            gather_counts.push_back(cols_part.count(i, gj));
+            gather_displs.push_back(static_cast<int>(local_cols.size()));
+            for (int k = 0; k < cols_part.count(i, gj); ++k)
+                local_cols.push_back(cols_part.displ(i, gj) + k);
+        }
+        for (int j = 0; j < pc; ++j)
+            scatter_counts.push_back(rows_part.count(gi, j));
+
+        a.resize(static_cast<size_t>(local_rows) * local_cols.size());
+        x_cols.resize(local_cols.size());
+        partial.resize(local_rows);
+    }
+
+    ~DistributedMatrix() {
+        MPI_Comm_free(&row_comm);
+        MPI_Comm_free(&col_comm);
+    }
+
+    DistributedMatrix(const DistributedMatrix&) = delete;
+    DistributedMatrix& operator=(const DistributedMatrix&) = delete;
+
+    // a(i, j) по глобальным индексам, только для своего блока
+    template <typename Fn>
+    void fill(Fn fn) {
+        size_t ncols = local_cols.size();
+        #pragma omp parallel for schedule(static)
+        for (int r = 0; r < local_rows; ++r)
+            for (size_t k = 0; k < ncols; ++k)
+                a[r * ncols + k] = fn(row_begin + r, local_cols[k]);
+    }
+
+    // x_local - отрезок x этого процесса (x_offset(), x_count()), y_local - отрезок y
+    void gemv(const double* x_local, double* y_local) {
+        double t0 = MPI_Wtime();
+        {
+            TRACE_SCOPE("allgather");
+            MPI_Allgatherv(x_local, x_count(), MPI_DOUBLE, x_cols.data(), gather_counts.data(),
+                           gather_displs.data(), MPI_DOUBLE, col_comm);
+        }
+        double t1 = MPI_Wtime();
+
+        double* out = pc == 1 ? y_local : partial.data();
+        size_t ncols = local_cols.size();
+        const double* xc = x_cols.data();
+        #pragma omp parallel
+        {
+            TRACE_SCOPE("matvec");
+            #pragma omp for schedule(static)
+            for (int r = 0; r < local_rows; ++r) {
+                const double* row = &a[r * ncols];
+                double sum = 0.0;
+                #pragma omp simd reduction(+:sum)
+                for (size_t k = 0; k < ncols; ++k)
+                    sum += row[k] * xc[k];
+                out[r] = sum;
+            }
+        }
+        double t2 = MPI_Wtime();
+
+        if (pc > 1) {
+            TRACE_SCOPE("reduce_scatter");
+            MPI_Reduce_scatter(partial.data(), y_local, scatter_counts.data(), MPI_DOUBLE, MPI_SUM, row_comm);
+        }
+        double t3 = MPI_Wtime();
+        comm_seconds += (t1 - t0) + (t3 - t2);
+        compute_seconds += t2 - t1;
+    }
+
+    void gemv(const std::vector<double>& x_local, std::vector<double>& y_local) {
+        y_local.resize(y_count());
+        gemv(x_local.data(), y_local.data());
+    }
+
+    // Отрезки вектора x (длины m) и y (длины n) этого процесса
+    int x_offset() const { return cols_part.displs[rank]; }
+    int x_count() const { return cols_part.counts[rank]; }
+    int y_offset() const { return rows_part.displs[rank]; }
+    int y_count() const { return rows_part.counts[rank]; }
+
+    int grid_rows() const { return pr; }
+    int grid_cols() const { return pc; }
+    MPI_Comm communicator() const { return comm; }
+    size_t local_bytes() const { return a.size() * sizeof(double); }
+
+    double comm_time() const { return comm_seconds; }
+    double compute_time() const { return compute_seconds; }
+
+private:
+    long n, m;
+    MPI_Comm comm, row_comm, col_comm;
+    int rank, nprocs, pr, pc, gi, gj;
+    VectorPartition rows_part, cols_part;
+    int local_rows, row_begin;
+    std::vector<int> local_cols;                    // глобальные номера столбцов блока
+    std::vector<int> gather_counts, gather_displs;  // внутри столбца решетки
+    std::vector<int> scatter_counts;                // внутри строки решетки
+    std::vector<double> a, x_cols, partial;
+    double comm_seconds = 0.0, compute_seconds = 0.0;
+};
+
+// Скалярное произведение распределенных векторов
+inline double distributed_dot(const std::vector<double>& x, const std::vector<double>& y, MPI_Comm comm) {
+    double local = 0.0;
+    #pragma omp parallel for reduction(+:local) schedule(static)
+    for (size_t i = 0; i < x.size(); ++i)
+        local += x[i] * y[i];
+    double global = 0.0;
+    MPI_Allreduce(&local, &global, 1, MPI_DOUBLE, MPI_SUM, comm);
+    return global;
+}
@@ -0,0 +1,437 @@
+#pragma once
+
+// Матрица на диске, которая не помещается в память: файл из горизонтальных полос
+// (panel) по tile_rows строк, каждая полоса - строки подряд, выровненные на 4 КБ, чтобы
+// читать их и через O_DIRECT.
+//
+//   [заголовок 4 КБ][полоса 0][полоса 1]...
+//
+// stream_panels() отдает полосы по очереди, подгружая следующую, пока обрабатывается
+// текущая (двойная буферизация). Источники:
+//   Mmap  - отображение файла, madvise(WILLNEED) на следующую полосу и DONTNEED на пройденную;
+//   Uring - io_uring без liburing: чтение следующей полосы кусками в два буфера,
+//           с O_DIRECT мимо страничного кэша;
+//   Pread - pread следующей полосы в отдельном потоке, если io_uring недоступен.
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <future>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <omp.h>
+
+constexpr size_t TILE_ALIGN = 4096;
+constexpr char TILED_MAGIC[8] = {'D', 'Z', 'T', 'I', 'L', 'E', '1', '\0'};
+
+struct TiledHeader {
+    char magic[8];
+    uint64_t n, m;
+    uint64_t tile_rows;
+    uint64_t panel_stride;  // байт на полосу вместе с выравниванием
+};
+
+inline size_t align_up(size_t bytes, size_t alignment) { return (bytes + alignment - 1) / alignment * alignment; }
+
+// Буфер, выровненный под O_DIRECT
+struct AlignedBuffer {
+    std::unique_ptr<char, decltype(&std::free)> data{nullptr, &std::free};
+    size_t size = 0;
+
+    explicit AlignedBuffer(size_t bytes = 0) { resize(bytes); }
+
+    void resize(size_t bytes) {
+        size = align_up(bytes, TILE_ALIGN);
+        data.reset(size ? static_cast<char*>(std::aligned_alloc(TILE_ALIGN, size)) : nullptr);
+        if (size && !data)
+            throw std::bad_alloc();
+    }
+
+    double* doubles() const { return reinterpret_cast<double*>(data.get()); }
+};
+
+inline void pread_full(int fd, char* buf, size_t len, uint64_t offset) {
+    while (len > 0) {
+        ssize_t n = ::pread(fd, buf, len, static_cast<off_t>(offset));
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0)
+            throw std::runtime_error(std::string("pread failed: ") + (n < 0 ? std::strerror(errno) : "end of file"));
+        buf += n;
+        len -= static_cast<size_t>(n);
+        offset += static_cast<uint64_t>(n);
+    }
+}
+
+class TiledMatrixWriter {
+public:
+    // fn(i, j) - значение элемента; полоса заполняется потоками OpenMP и пишется целиком
+    template <typename Fn>
+    static void create(const std::string& path, uint64_t n, uint64_t m, uint64_t tile_rows, Fn fn) {
+        int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0)
+            throw std::runtime_error("Cannot create file: " + path);
+        TiledHeader header{};
+        std::memcpy(header.magic, TILED_MAGIC, sizeof(TILED_MAGIC));
+        header.n = n;
+        header.m = m;
+        header.tile_rows = tile_rows;
+        header.panel_stride = align_up(tile_rows * m * sizeof(double), TILE_ALIGN);
+        AlignedBuffer head(TILE_ALIGN);
+        std::memset(head.data.get(), 0, TILE_ALIGN);
+        std::memcpy(head.data.get(), &header, sizeof(header));
+        write_full(fd, head.data.get(), TILE_ALIGN);
+
+        AlignedBuffer panel(header.panel_stride);
+        for (uint64_t row0 = 0; row0 < n; row0 += tile_rows) {
+            uint64_t rows = std::min(tile_rows, n - row0);
+            double* a = panel.doubles();
+            #pragma omp parallel for schedule(static)
+            for (uint64_t r = 0; r < rows; ++r)
+                for (uint64_t j = 0; j < m; ++j)
+                    a[r * m + j] = fn(row0 + r, j);
+            std::memset(panel.data.get() + rows * m * sizeof(double), 0,
+                        header.panel_stride - rows * m * sizeof(double));
+            write_full(fd, panel.data.get(), header.panel_stride);
+        }
+        ::close(fd);
+    }
+
+private:
+    static void write_full(int fd, const char* buf, size_t len) {
+        while (len > 0) {
+            ssize_t n = ::write(fd, buf, len);
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0)
+                throw std::runtime_error(std::string("write failed: ") + std::strerror(errno));
+            buf += n;
+            len -= static_cast<size_t>(n);
+        }
+    }
+};
+
+class TiledMatrixFile {
+public:
+    explicit TiledMatrixFile(const std::string& path) : path(path) {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            throw std::runtime_error("Cannot open file: " + path);
+        struct stat st;
+        bool stat_ok = fstat(fd, &st) == 0;
+        ssize_t n = ::pread(fd, &header, sizeof(header), 0);
+        ::close(fd);
+        if (!stat_ok)
+            throw std::runtime_error("Cannot stat file: " + path);
+        if (n != sizeof(header) || std::memcmp(header.magic, TILED_MAGIC, sizeof(TILED_MAGIC)) != 0)
+            throw std::runtime_error("Not a tiled matrix file: " + path);
+        validate(static_cast<uint64_t>(st.st_size));
+    }
+
+    uint64_t rows() const { return header.n; }
+    uint64_t cols() const { return header.m; }
+    uint64_t tile_rows() const { return header.tile_rows; }
+    uint64_t panels() const { return header.n / header.tile_rows + (header.n % header.tile_rows != 0); }
+    uint64_t panel_rows(uint64_t k) const { return std::min(header.tile_rows, header.n - k * header.tile_rows); }
+    uint64_t panel_stride() const { return header.panel_stride; }
+    uint64_t panel_offset(uint64_t k) const { return TILE_ALIGN + k * header.panel_stride; }
+    uint64_t file_bytes() const { return panel_offset(panels()); }
+    const std::string& file_path() const { return path; }
+
+private:
+    // Заголовок должен описывать полосы, которые целиком лежат в файле: иначе деление на
+    // ноль, чтение за концом полосы или SIGBUS при обращении к отображению
+    void validate(uint64_t size) const {
+        uint64_t row_bytes, panel_bytes, data_bytes;
+        if (header.tile_rows == 0 || header.m == 0)
+            throw std::runtime_error("Bad tiled matrix header (zero tile_rows or columns): " + path);
+        if (__builtin_mul_overflow(header.m, sizeof(double), &row_bytes)
+            || __builtin_mul_overflow(header.tile_rows, row_bytes, &panel_bytes)
+            || header.panel_stride < panel_bytes || header.panel_stride % TILE_ALIGN != 0)
+            throw std::runtime_error("Bad panel stride in " + path);
+        if (size < TILE_ALIGN || __builtin_mul_overflow(panels(), header.panel_stride, &data_bytes)
+            || data_bytes > size - TILE_ALIGN)
+            throw std::runtime_error("Truncated tiled matrix file: " + path);
+    }
+
+    std::string path;
+    TiledHeader header{};
+};
+
+// Минимальная обертка над io_uring через системные вызовы
+class IoUring {
+public:
+    explicit IoUring(unsigned entries) {
+        io_uring_params params{};
+        ring_fd = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+        if (ring_fd < 0)
+            throw std::runtime_error(std::string("io_uring_setup failed: ") + std::strerror(errno));
+
+        sq_bytes = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cq_bytes = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        bool single = params.features & IORING_FEAT_SINGLE_MMAP;
+        if (single)
+            sq_bytes = cq_bytes = std::max(sq_bytes, cq_bytes);
+        sq_ring = map(sq_bytes, IORING_OFF_SQ_RING);
+        cq_ring = single ? sq_ring : map(cq_bytes, IORING_OFF_CQ_RING);
+        sqes = static_cast<io_uring_sqe*>(map(params.sq_entries * sizeof(io_uring_sqe), IORING_OFF_SQES));
+        sqe_bytes = params.sq_entries * sizeof(io_uring_sqe);
+
+        char* sq = static_cast<char*>(sq_ring);
+        char* cq = static_cast<char*>(cq_ring);
+        sq_head = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+        sq_tail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+        sq_mask = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+        sq_entries = params.sq_entries;
+        sq_array = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+        cq_head = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+        cq_tail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+        cq_mask = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+        cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+    }
+
+    ~IoUring() {
+        munmap(sqes, sqe_bytes);
+        if (cq_ring != sq_ring) munmap(cq_ring, cq_bytes);
+        munmap(sq_ring, sq_bytes);
+        ::close(ring_fd);
+    }
+
+    IoUring(const IoUring&) = delete;
+    IoUring& operator=(const IoUring&) = delete;
+
+    unsigned capacity() const { return sq_entries; }
+
+    // Кладет запрос в очередь; отправляет ядру submit()
+    void prepare_read(int fd, char* buf, unsigned len, uint64_t offset, uint64_t user_data) {
+        unsigned tail = *sq_tail;
+        if (tail - std::atomic_ref<unsigned>(*sq_head).load(std::memory_order_acquire) == sq_entries)
+            throw std::runtime_error("io_uring submission queue is full");
+        unsigned index = tail & sq_mask;
+        io_uring_sqe& sqe = sqes[index];
+        std::memset(&sqe, 0, sizeof(sqe));
+        sqe.opcode = IORING_OP_READ;
+        sqe.fd = fd;
+        sqe.addr = reinterpret_cast<uint64_t>(buf);
+        sqe.len = len;
+        sqe.off = offset;
+        sqe.user_data = user_data;
+        sq_array[index] = index;
+        std::atomic_ref<unsigned>(*sq_tail).store(tail + 1, std::memory_order_release);
+        ++unsubmitted;
+    }
+
+    void submit() {
+        while (unsubmitted > 0) {
+            int n = static_cast<int>(syscall(__NR_io_uring_enter, ring_fd, unsubmitted, 0, 0, nullptr, 0));
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0)
+                throw std::runtime_error(std::string("io_uring_enter failed: ") + std::strerror(errno));
+            unsubmitted -= static_cast<unsigned>(n);
+        }
+    }
+
+    io_uring_cqe wait() {
+        while (true) {
+            unsigned head = *cq_head;
+            if (head != std::atomic_ref<unsigned>(*cq_tail).load(std::memory_order_acquire)) {
+                io_uring_cqe cqe = cqes[head & cq_mask];
+                std::atomic_ref<unsigned>(*cq_head).store(head + 1, std::memory_order_release);
+                return cqe;
+            }
+            int n = static_cast<int>(syscall(__NR_io_uring_enter, ring_fd, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0));
+            if (n < 0 && errno != EINTR)
+                throw std::runtime_error(std::string("io_uring_enter failed: ") + std::strerror(errno));
+        }
+    }
+
+private:
+    void* map(size_t bytes, uint64_t offset) {
+        void* p = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, offset);
+        if (p == MAP_FAILED)
+            throw std::runtime_error("io_uring mmap failed");
+        return p;
+    }
+
+    int ring_fd = -1;
+    void* sq_ring = nullptr;
+    void* cq_ring = nullptr;
+    io_uring_sqe* sqes = nullptr;
+    size_t sq_bytes = 0, cq_bytes = 0, sqe_bytes = 0;
+    unsigned *sq_head, *sq_tail, *sq_array, *cq_head, *cq_tail;
+    unsigned sq_mask, sq_entries, cq_mask;
+    io_uring_cqe* cqes;
+    unsigned unsubmitted = 0;
+};
+
+enum class TileSource { Mmap, Uring, Pread };
+
+inline const char* tile_source_name(TileSource source) {
+    switch (source) {
+        case TileSource::Mmap: return "mmap";
+        case TileSource::Uring: return "io_uring";
+        default: return "pread";
+    }
+}
+
+// Чтение полосы через io_uring кусками по chunk байт, чтобы у устройства была очередь
+class UringPanelReader {
+public:
+    static constexpr unsigned QUEUE_DEPTH = 64;
+    static constexpr size_t CHUNK = 1 << 20;
+
+    UringPanelReader(int fd) : fd(fd), ring(QUEUE_DEPTH) {}
+
+    void start(const TiledMatrixFile& file, uint64_t k, AlignedBuffer& buf) {
+        pending.push_back({file.panel_offset(k), file.panel_stride(), buf.data.get()});
+        pump();
+    }
+
+    // Ждет, пока все начатые полосы не будут прочитаны целиком
+    void finish() {
+        while (!pending.empty() || in_flight > 0) {
+            pump();
+            io_uring_cqe cqe = ring.wait();
+            --in_flight;
+            Request& r = requests[cqe.user_data];
+            if (cqe.res < 0)
+                throw std::runtime_error(std::string("io_uring read failed: ") + std::strerror(-cqe.res));
+            if (cqe.res == 0)
+                throw std::runtime_error("io_uring read hit end of file");
+            if (static_cast<size_t>(cqe.res) < r.len)  // короткое чтение - дочитываем
+                pending.push_back({r.offset + cqe.res, r.len - cqe.res, r.buf + cqe.res});
+            free_slots.push_back(cqe.user_data);
+        }
+    }
+
+private:
+    struct Request {
+        uint64_t offset;
+        size_t len;
+        char* buf;
+    };
+
+    void pump() {
+        while (!pending.empty() && in_flight < ring.capacity()) {
+            Request& r = pending.back();
+            size_t len = std::min(r.len, CHUNK);
+            uint64_t slot;
+            if (!free_slots.empty()) {
+                slot = free_slots.back();
+                free_slots.pop_back();
+            } else {
+                slot = requests.size();
+                requests.emplace_back();
+            }
+            requests[slot] = {r.offset, len, r.buf};
+            ring.prepare_read(fd, r.buf, static_cast<unsigned>(len), r.offset, slot);
+            ++in_flight;
+            r.offset += len;
+            r.buf += len;
+            r.len -= len;
+            if (r.len == 0) pending.pop_back();
+        }
+        ring.submit();
+    }
+
+    int fd;
+    IoUring ring;
+    std::vector<Request> pending, requests;
+    std::vector<uint64_t> free_slots;
+    unsigned in_flight = 0;
+};
+
+// consume(k, const double* panel, rows) для каждой полосы по порядку
+template <typename Consume>
+void stream_panels(const TiledMatrixFile& file, TileSource source, bool direct, Consume consume) {
+    uint64_t panels = file.panels();
+    if (source == TileSource::Mmap) {
+        int fd = ::open(file.file_path().c_str(), O_RDONLY);
+        if (fd < 0)
+            throw std::runtime_error("Cannot open file: " + file.file_path());
+        size_t bytes = file.file_bytes();
+        void* p = mmap(nullptr, bytes, PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (p == MAP_FAILED)
+            throw std::runtime_error("Cannot map file: " + file.file_path());
+        char* base = static_cast<char*>(p);
+        madvise(p, bytes, MADV_SEQUENTIAL);
+        for (uint64_t k = 0; k < panels; ++k) {
+            if (k + 1 < panels)
+                madvise(base + file.panel_offset(k + 1), file.panel_stride(), MADV_WILLNEED);
+            consume(k, reinterpret_cast<const double*>(base + file.panel_offset(k)), file.panel_rows(k));
+            madvise(base + file.panel_offset(k), file.panel_stride(), MADV_DONTNEED);
+        }
+        munmap(p, bytes);
+        return;
+    }
+
+    int fd = ::open(file.file_path().c_str(), O_RDONLY | (direct ? O_DIRECT : 0));
+    if (fd < 0)
+        throw std::runtime_error("Cannot open file: " + file.file_path());
+    AlignedBuffer buffers[2] = {AlignedBuffer(file.panel_stride()), AlignedBuffer(file.panel_stride())};
+    try {
+        if (source == TileSource::Uring) {
+            UringPanelReader reader(fd);
+            reader.start(file, 0, buffers[0]);
+            reader.finish();
+            for (uint64_t k = 0; k < panels; ++k) {
+                if (k + 1 < panels)
+                    reader.start(file, k + 1, buffers[(k + 1) % 2]);
+                consume(k, buffers[k % 2].doubles(), file.panel_rows(k));
+                reader.finish();
+            }
+        } else {
+            auto load = [&](uint64_t k) {
+                pread_full(fd, buffers[k % 2].data.get(), file.panel_stride(), file.panel_offset(k));
+            };
+            load(0);
+            for (uint64_t k = 0; k < panels; ++k) {
+                std::future<void> next;
+                if (k + 1 < panels)
+                    next = std::async(std::launch::async, load, k + 1);
+                consume(k, buffers[k % 2].doubles(), file.panel_rows(k));
+                if (next.valid()) next.get();
+            }
+        }
+    } catch (...) {
+        ::close(fd);
+        throw;
+    }
+    ::close(fd);
+}
+
+// Сбрасывает файл из страничного кэша, чтобы следующее чтение шло с устройства
+inline void drop_file_cache(const std::string& path) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return;
+    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    ::close(fd);
+}
+
+// Скорость чтения файла тем же источником, что и в stream_panels, но без вычислений:
+// из каждой страницы полосы читается одно число (у mmap это и есть подгрузка страниц).
+// Байт в секунду
+inline double raw_read_speed(const TiledMatrixFile& file, TileSource source, bool direct) {
+    volatile double sink = 0.0;
+    double t = omp_get_wtime();
+    stream_panels(file, source, direct, [&](uint64_t, const double* a, uint64_t rows) {
+        size_t count = rows * file.cols(), step = TILE_ALIGN / sizeof(double);
+        double sum = 0.0;
+        for (size_t i = 0; i < count; i += step)
+            sum += a[i];
+        sink = sink + sum;
+    });
+    return file.file_bytes() / (omp_get_wtime() - t);
+}
@@ -0,0 +1,176 @@
+#pragma once
+
+// Трассировка для просмотра таймлайна в chrome://tracing или ui.perfetto.dev.
+// Включается флагом -DENABLE_TRACE, без него TRACE_SCOPE раскрывается в пустой оператор.
+//
+//   TRACE_SCOPE("matvec");   // событие от этой строки до конца блока
+//
+// Каждый поток пишет в свой кольцевой буфер без блокировок (при переполнении затираются
+// самые старые события). Событие записывается один раз при выходе из блока как пара
+// начало/конец ("ph":"X" в формате Chrome trace-event). При завершении программы (atexit)
+// все буферы сбрасываются в JSON-файл: $TRACE_FILE или trace.json.
+//
+// Tracer и буферы потоков не освобождаются никогда: поток, который пишет событие во время
+// или после сброса, не обратится к освобожденной памяти. dump() не останавливает писателей:
+// он копирует кольцо и отбрасывает события, которые могли быть перезаписаны во время чтения.
+
+#ifdef ENABLE_TRACE
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#ifndef TRACE_BUFFER_EVENTS
+#define TRACE_BUFFER_EVENTS (1 << 14)
+#endif
+
+namespace trace {
+
+// Поля атомарные, чтобы dump() мог читать кольцо одновременно с писателем; relaxed-запись
+// на x86 - обычный mov
+struct Event {
+    std::atomic<const char*> name;  // строковый литерал, хранится только указатель
+    std::atomic<uint64_t> begin;
+    std::atomic<uint64_t> end;
+};
+
+// rdtsc стоит единицы наносекунд против ~20 нс у steady_clock; перевод тиков в время
+// делается один раз при сбросе по двум опорным точкам
+inline uint64_t now_ticks() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+struct ThreadBuffer {
+    uint32_t tid;
+    std::atomic<uint64_t> head{0};
+    Event events[TRACE_BUFFER_EVENTS];
+
+    // Барьер отделяет прошлую запись head от записи слота: если dump() увидел новое
+    // содержимое слота, он увидит и head, по которому поймет, что слот перезаписан
+    void push(const char* name, uint64_t begin, uint64_t end) {
+        uint64_t h = head.load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        Event& e = events[h % TRACE_BUFFER_EVENTS];
+        e.name.store(name, std::memory_order_relaxed);
+        e.begin.store(begin, std::memory_order_relaxed);
+        e.end.store(end, std::memory_order_relaxed);
+        head.store(h + 1, std::memory_order_release);
+    }
+};
+
+struct EventCopy {
+    const char* name;
+    uint64_t begin;
+    uint64_t end;
+};
+
+class Tracer {
+public:
+    static Tracer& instance() {
+        static Tracer* tracer = new Tracer;
+        return *tracer;
+    }
+
+    // Буфер потока регистрируется при первом событии и живет до конца программы,
+    // чтобы события завершившихся потоков тоже попали в дамп
+    ThreadBuffer* register_thread() {
+        std::lock_guard<std::mutex> lock(mutex);
+        buffers.push_back(std::make_unique<ThreadBuffer>());
+        buffers.back()->tid = static_cast<uint32_t>(buffers.size());
+        return buffers.back().get();
+    }
+
+    void dump() {
+        std::lock_guard<std::mutex> lock(mutex);
+        uint64_t ticks1 = now_ticks();
+        auto time1 = std::chrono::steady_clock::now();
+        double ns_per_tick = ticks1 > ticks0
+            ? std::chrono::duration<double, std::nano>(time1 - time0).count() / (ticks1 - ticks0)
+            : 1.0;
+
+        const char* path = std::getenv("TRACE_FILE");
+        FILE* out = std::fopen(path ? path : "trace.json", "w");
+        if (!out) return;
+        std::fputs("{\"traceEvents\":[\n", out);
+        bool first = true;
+        std::vector<EventCopy> copy;
+        for (const auto& buffer : buffers) {
+            uint64_t head = buffer->head.load(std::memory_order_acquire);
+            uint64_t from = head > TRACE_BUFFER_EVENTS ? head - TRACE_BUFFER_EVENTS : 0;
+            copy.clear();
+            for (uint64_t i = from; i < head; ++i) {
+                const Event& e = buffer->events[i % TRACE_BUFFER_EVENTS];
+                copy.push_back({e.name.load(std::memory_order_relaxed), e.begin.load(std::memory_order_relaxed),
+                                e.end.load(std::memory_order_relaxed)});
+            }
+            // Пока шло копирование, писатель мог дойти до head_after и затереть слоты
+            // индексов не больше head_after - TRACE_BUFFER_EVENTS
+            std::atomic_thread_fence(std::memory_order_acquire);
+            uint64_t head_after = buffer->head.load(std::memory_order_relaxed);
+            uint64_t valid = head_after >= TRACE_BUFFER_EVENTS ? head_after - TRACE_BUFFER_EVENTS + 1 : 0;
+            for (uint64_t i = std::max(from, valid); i < head; ++i) {
+                const EventCopy& e = copy[i - from];
+                double ts = (e.begin - ticks0) * ns_per_tick / 1000.0;
+                double dur = (e.end - e.begin) * ns_per_tick / 1000.0;
+                std::fprintf(out, "%s{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%u}",
+                             first ? "" : ",\n", e.name, ts, dur, buffer->tid);
+                first = false;
+            }
+        }
+        std::fputs("\n]}\n", out);
+        std::fclose(out);
+    }
+
+private:
+    Tracer() : ticks0(now_ticks()), time0(std::chrono::steady_clock::now()) {
+        std::atexit([] { instance().dump(); });
+    }
+
+    std::mutex mutex;
+    std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+    uint64_t ticks0;
+    std::chrono::steady_clock::time_point time0;
+};
+
+inline ThreadBuffer* thread_buffer() {
+    thread_local ThreadBuffer* buffer = Tracer::instance().register_thread();
+    return buffer;
+}
+
+class Scope {
+public:
+    explicit Scope(const char* name) : buffer(thread_buffer()), name(name), begin(now_ticks()) {}
+    ~Scope() { buffer->push(name, begin, now_ticks()); }
+
+private:
+    ThreadBuffer* buffer;
+    const char* name;
+    uint64_t begin;
+};
+
+}  // namespace trace
+
+#define TRACE_CONCAT_IMPL(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_IMPL(a, b)
+#define TRACE_SCOPE(name) trace::Scope TRACE_CONCAT(trace_scope_, __LINE__)(name)
+
+#else
+
+#define TRACE_SCOPE(name) do {} while (0)
+
+#endif
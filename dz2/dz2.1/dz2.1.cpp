@@ -1,22 +1,40 @@
+// g++ -std=c++20 -O3 -fopenmp -march=native dz2.1.cpp -o dz2.1
+
 #include <iostream>
 #include <omp.h>
 
+#include <vector>
+#include <string>
+#include <cmath>
+#include <cstdlib>
+#include <climits>
+#include <memory>
+
+#include "../../common/compressed_matrix.h"
+#include "../../common/gemv.h"
+#include "../../common/matrix_file.h"
+#include "../../common/trace.h"
+
 int SIZE, THREADS = 1;
 
-void init_arrays(double* a, double* b, int n, int m) {
-    #pragma omp parallel
+// Матрица заполняется тем же разбиением на потоки, что и при умножении (gemv.h), чтобы
+// страницы оказались в памяти узлов, где их потом читают. b длины m заполняется отдельно:
+// при n != m его нельзя заполнять в цикле по строкам
+void init_arrays(double* a, double* b, size_t n, size_t m) {
+    GemvPartition part = choose_partition(n, m, THREADS);
+    #pragma omp parallel num_threads(part.threads())
     {
-        int nthreads = omp_get_num_threads();
-        int threadid = omp_get_thread_num();
-        int items_per_thread = n / nthreads;
-        int lb = threadid * items_per_thread;
-        int ub = (threadid == nthreads - 1) ? (n - 1) : (lb + items_per_thread - 1);
-
-        for (int i = lb; i <= ub; i++) {
-            for (int j = 0; j < m; j++)
-                a[i * m + j] = i + j;  // Используем m для индексации
-            b[i] = i;
+        TRACE_SCOPE("init_arrays");
+        for (int t = omp_get_thread_num(); t < part.threads(); t += omp_get_num_threads()) {
+            GemvBlock blk = part.block(t, n, m);
+            for (size_t i = blk.r0; i < blk.r1; i++)
+                for (size_t j = blk.c0; j < blk.c1; j++)
+                    a[i * m + j] = double(i + j);
         }
+
+        #pragma omp for schedule(static)
+        for (size_t j = 0; j < m; j++)
+            b[j] = double(j);
     }
 }
 
@@ -24,10 +42,11 @@ void run_serial(const double a[], const double b[], int n, int m) {
     auto* res = new double[n]();
     double start = omp_get_wtime();
 
+    TRACE_SCOPE("matvec_serial");
     for (int i = 0; i < n; i++) {
         res[i] = 0.0;
         for (int j = 0; j < m; j++) {
-            res[i] += a[i * m + j] * b[j];  // Используем m для индексации
+            res[i] += a[size_t(i) * m + j] * b[j];  // Используем m для индексации
         }
     }
 
@@ -42,20 +61,10 @@ void run_parallel(const double a[], const double b[], int n, int m) {
     auto* res = new double[n]();
     double start = omp_get_wtime();
 
-    #pragma omp parallel num_threads(THREADS)
     {
-        int nthreads = omp_get_num_threads();
-        int threadid = omp_get_thread_num();
-        int items_per_thread = n / nthreads;
-        int lb = threadid * items_per_thread;
-        int ub = (threadid == nthreads - 1) ? (n - 1) : (lb + items_per_thread - 1);
-
-        for (int i = lb; i <= ub; i++) {
-            res[i] = 0.0;
-            for (int j = 0; j < m; j++) {
-                res[i] += a[i * m + j] * b[j];  // Используем m для индексации
-            }
-        }
+        TRACE_SCOPE("matvec");
+        // То же разбиение, что и при заполнении в init_arrays
+        gemv_partitioned(a, b, res, n, m, THREADS);
     }
 
     double end = omp_get_wtime();
@@ -65,10 +74,199 @@ void run_parallel(const double a[], const double b[], int n, int m) {
     delete[] res;
 }
 
-int main() {
+// Матрица и вектор из файлов matrix_tool (../../common/matrix_file.h): данные читаются
+// прямо из отображения, без генерации и копирования
+int run_from_files(const char* a_path, const char* b_path, const int* threads, int count) {
+    try {
+        MappedMatrix a(a_path), b(b_path);
+        if (a.kind() != MatrixKind::Dense || a.layout() != MatrixLayout::RowMajor || b.kind() != MatrixKind::Vector
+            || b.rows() != a.cols())
+            throw std::runtime_error("Expected a row-major dense matrix and a vector of matching size");
+        if (a.rows() > INT_MAX || a.cols() > INT_MAX)
+            throw std::runtime_error("Matrix is too large: " + std::to_string(a.rows()) + "x" + std::to_string(a.cols()));
+        int n = static_cast<int>(a.rows()), m = static_cast<int>(a.cols());
+        for (int j = 0; j < count; j++) {
+            THREADS = threads[j];
+            if (THREADS == 1)
+                run_serial(a.values<double>(), b.values<double>(), n, m);
+            else
+                run_parallel(a.values<double>(), b.values<double>(), n, m);
+        }
+        std::cout << "\n";
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << "\n";
+        return 1;
+    }
+    return 0;
+}
+
+// Вытянутые матрицы: разбиение только по строкам против разбиения по форме (gemv.h)
+void run_shape(size_t n, size_t m, const int* threads, int count) {
+    THREADS = threads[count - 1];
+    // Без инициализации: первым страницы a и b трогает init_arrays
+    std::unique_ptr<double[]> a(new double[n * m]), b(new double[m]);
+    std::vector<double> res_rows(n), res_2d(n);
+    init_arrays(a.get(), b.get(), n, m);
+    double gb = n * m * sizeof(double) / 1e9;
+    std::cout << n << "x" << m << " (" << gb << " GB)\n";
+
+    for (int k = 0; k < count; k++) {
+        int nthreads = threads[k];
+        GemvPartition rows_only{nthreads, 1}, shaped = choose_partition(n, m, nthreads);
+
+        double t_rows = omp_get_wtime();
+        gemv_partitioned(a.get(), b.get(), res_rows.data(), n, m, rows_only);
+        t_rows = omp_get_wtime() - t_rows;
+
+        double t_2d = omp_get_wtime();
+        gemv_partitioned(a.get(), b.get(), res_2d.data(), n, m, shaped);
+        t_2d = omp_get_wtime() - t_2d;
+
+        // res[i] = sum_j (i + j) j = i S1 + S2
+        double s1 = double(m) * (m - 1) / 2, s2 = double(m - 1) * m * (2 * m - 1) / 6;
+        double err = 0.0;
+        for (size_t i = 0; i < n; i++)
+            err = std::max(err, std::fabs(res_2d[i] - (i * s1 + s2)) / (i * s1 + s2));
+
+        std::cout << "  " << nthreads << " threads: rows " << t_rows << " s (" << gb / t_rows << " GB/s), "
+                  << shaped.pr << "x" << shaped.pc << " grid " << t_2d << " s (" << gb / t_2d
+                  << " GB/s), max relative error " << err << "\n";
+    }
+}
+
+// A^T x на той же матрице: обход столбцов с шагом m против gemv(Trans::Yes, ...)
+void run_trans(size_t n, size_t m) {
+    THREADS = omp_get_max_threads();
+    std::unique_ptr<double[]> a(new double[n * m]), b(new double[m]);
+    std::vector<double> x(n), y(n), yt(m), yt_naive(m);
+    init_arrays(a.get(), b.get(), n, m);
+    for (size_t i = 0; i < n; i++)
+        x[i] = double(i);
+    double gb = n * m * sizeof(double) / 1e9;
+
+    double t_fwd = omp_get_wtime();
+    gemv(Trans::No, a.get(), b.get(), y.data(), n, m);
+    t_fwd = omp_get_wtime() - t_fwd;
+
+    double t_trans = omp_get_wtime();
+    gemv(Trans::Yes, a.get(), x.data(), yt.data(), n, m);
+    t_trans = omp_get_wtime() - t_trans;
+
+    double t_naive = omp_get_wtime();
+    #pragma omp parallel for schedule(static)
+    for (size_t j = 0; j < m; j++) {
+        double sum = 0.0;
+        for (size_t i = 0; i < n; i++)
+            sum += a[i * m + j] * x[i];
+        yt_naive[j] = sum;
+    }
+    t_naive = omp_get_wtime() - t_naive;
+
+    // yt[j] = sum_i (i + j) i = S2(n) + j S1(n)
+    double s1 = double(n) * (n - 1) / 2, s2 = double(n - 1) * n * (2 * n - 1) / 6;
+    double err = 0.0;
+    for (size_t j = 0; j < m; j++)
+        err = std::max(err, std::fabs(yt[j] - (s2 + j * s1)) / (s2 + j * s1));
+
+    std::cout << n << "x" << m << ", " << THREADS << " threads: A x " << gb / t_fwd << " GB/s, A^T x "
+              << gb / t_trans << " GB/s, column walk " << gb / t_naive << " GB/s, max relative error " << err << "\n";
+}
+
+// Лучшее время из нескольких запусков
+template <typename Fn>
+double best_time(Fn fn, int reps = 5) {
+    double best = 1e300;
+    for (int r = 0; r < reps; r++) {
+        double t = omp_get_wtime();
+        fn();
+        best = std::min(best, omp_get_wtime() - t);
+    }
+    return best;
+}
+
+// Умножение на сжатую матрицу: степень сжатия, ошибка относительно плотного умножения, ускорение
+void run_compressed(const char* name, const double* a, const std::vector<double>& b, size_t n, size_t m) {
+    std::vector<double> y(n), yc(n);
+    double t_dense = best_time([&] { gemv(Trans::No, a, b.data(), y.data(), n, m); });
+    std::cout << name << " " << n << "x" << m << ": dense " << n * m * sizeof(double) / 1e9 / t_dense << " GB/s\n";
+
+    for (Compression mode : {Compression::Lossless, Compression::Block16}) {
+        double t_build = omp_get_wtime();
+        CompressedMatrix c(a, n, m, mode);
+        t_build = omp_get_wtime() - t_build;
+        double t = best_time([&] { c.gemv(b.data(), yc.data()); });
+
+        // Ошибка относительно max |y|: у sin отдельные y[i] близки к нулю
+        double err = 0.0, scale = 0.0;
+        for (size_t i = 0; i < n; i++) {
+            err = std::max(err, std::fabs(yc[i] - y[i]));
+            scale = std::max(scale, std::fabs(y[i]));
+        }
+        err /= scale;
+        std::vector<size_t> counts = c.block_counts();
+        std::cout << "  " << (mode == Compression::Lossless ? "lossless" : "block16") << ": ratio " << c.ratio()
+                  << ", max relative error " << err << ", speedup " << t_dense / t << " (build " << t_build << " s;";
+        for (int k = 0; k < 5; k++)
+            if (counts[k]) std::cout << " " << CompressedMatrix::block_type_name(k) << " " << counts[k];
+        std::cout << ")\n";
+    }
+}
+
+void run_compression(size_t n, size_t m) {
+    THREADS = omp_get_max_threads();
+    std::unique_ptr<double[]> a(new double[n * m]);
+    std::vector<double> b(m);
+    init_arrays(a.get(), b.data(), n, m);
+    run_compressed("i + j", a.get(), b, n, m);
+
+    // Не арифметическая прогрессия, но с короткой мантиссой: без потерь идет в Xor16/Xor32
+    #pragma omp parallel for schedule(static)
+    for (size_t i = 0; i < n; i++)
+        for (size_t j = 0; j < m; j++)
+            a[i * m + j] = double(i + j) + double(i * j % 16) / 16;
+    run_compressed("i + j + (i j mod 16) / 16", a.get(), b, n, m);
+
+    #pragma omp parallel for schedule(static)
+    for (size_t i = 0; i < n; i++)
+        for (size_t j = 0; j < m; j++)
+            a[i * m + j] = std::sin(double(i * m + j));
+    run_compressed("sin", a.get(), b, n, m);
+}
+
+// ./dz2.1 [A.dzm b.dzm]
+// ./dz2.1 compress [n m]   по умолчанию 20000 x 20000
+// ./dz2.1 trans [n m]   по умолчанию 20000 x 20000, 100 x 10^7 и 10^7 x 100
+// ./dz2.1 shape [n m]   по умолчанию 100 x 10^7 и 10^7 x 100 (по 8 ГБ)
+int main(int argc, char** argv) {
     int arr1[] = {20000, 40000};
     int arr2[] = {1, 2, 4, 7, 8, 16, 20, 40};
 
+    if (argc > 1 && std::string(argv[1]) == "shape") {
+        if (argc > 3) {
+            run_shape(std::atoll(argv[2]), std::atoll(argv[3]), arr2, 8);
+        } else {
+            run_shape(100, 10000000, arr2, 8);
+            run_shape(10000000, 100, arr2, 8);
+        }
+        return 0;
+    }
+    if (argc > 1 && std::string(argv[1]) == "compress") {
+        run_compression(argc > 3 ? std::atoll(argv[2]) : 20000, argc > 3 ? std::atoll(argv[3]) : 20000);
+        return 0;
+    }
+    if (argc > 1 && std::string(argv[1]) == "trans") {
+        if (argc > 3) {
+            run_trans(std::atoll(argv[2]), std::atoll(argv[3]));
+        } else {
+            run_trans(20000, 20000);
+            run_trans(100, 10000000);
+            run_trans(10000000, 100);
+        }
+        return 0;
+    }
+    if (argc > 2)
+        return run_from_files(argv[1], argv[2], arr2, 8);
+
     for (int i = 0; i < 2; i++) {
         for (int j = 1; j < 8; j++) {  // Исправил количество итераций
             SIZE = arr1[i];
@@ -0,0 +1,76 @@
+#include <iostream>
+#include <vector>
+#include <cstdlib>
+#include <cmath>
+#include <memory>
+#include <stdexcept>
+#include <mpi.h>
+#include <omp.h>
+
+#include "../../common/mpi_gemv.h"
+
+// Умножение матрицы на вектор из dz2.1 (a[i][j] = i + j, b[j] = j), распределенное по
+// процессам MPI. Матрица n x m нигде не хранится целиком: при 40000^2 (12.8 ГБ) на каждый
+// из P процессов приходится 12.8 / P ГБ.
+//
+// mpicxx -std=c++20 -O3 -fopenmp dz2.1_mpi.cpp -o dz2.1_mpi
+// OMP_NUM_THREADS=2 mpirun -np 4 ./dz2.1_mpi [n] [m] [grid_cols] [reps]
+//   grid_cols: 1 - блоки строк, 0 - двумерная решетка по MPI_Dims_create, k - решетка P/k x k
+
+int main(int argc, char** argv) {
+    int provided;
+    MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &provided);
+    int rank, nprocs;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &nprocs);
+
+    long n = argc > 1 ? std::atol(argv[1]) : 20000;
+    long m = argc > 2 ? std::atol(argv[2]) : n;
+    int grid_cols = argc > 3 ? std::atoi(argv[3]) : 1;
+    int reps = argc > 4 ? std::atoi(argv[4]) : 10;
+    {
+        // Ошибку размеров или решетки получают все процессы одинаково
+        std::unique_ptr<DistributedMatrix> a_ptr;
+        try {
+            a_ptr = std::make_unique<DistributedMatrix>(n, m, MPI_COMM_WORLD, grid_cols);
+        } catch (const std::exception& e) {
+            if (rank == 0) std::cerr << e.what() << "\n";
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+        DistributedMatrix& a = *a_ptr;
+        a.fill([](long i, long j) { return double(i + j); });
+
+        std::vector<double> b(a.x_count()), res;
+        for (int k = 0; k < a.x_count(); ++k)
+            b[k] = a.x_offset() + k;
+
+        a.gemv(b, res);  // прогрев
+        MPI_Barrier(MPI_COMM_WORLD);
+        double t = MPI_Wtime();
+        for (int r = 0; r < reps; ++r)
+            a.gemv(b, res);
+        t = (MPI_Wtime() - t) / reps;
+
+        // res[i] = sum_j (i + j) j = i S1 + S2
+        double s1 = double(m) * (m - 1) / 2, s2 = double(m - 1) * m * (2 * m - 1) / 6;
+        double local_err = 0.0;
+        for (int k = 0; k < a.y_count(); ++k) {
+            double i = a.y_offset() + k;
+            local_err = std::max(local_err, std::fabs(res[k] - (i * s1 + s2)) / (i * s1 + s2));
+        }
+        double err = 0.0, max_t = 0.0;
+        MPI_Reduce(&local_err, &err, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+        MPI_Reduce(&t, &max_t, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+
+        if (rank == 0) {
+            std::cout << n << "x" << m << " on " << nprocs << " processes (" << a.grid_rows() << "x"
+                      << a.grid_cols() << "), " << omp_get_max_threads() << " threads each, "
+                      << a.local_bytes() / 1e6 << " MB per process\n";
+            std::cout << "time " << max_t << " s, " << 2.0 * n * m / max_t / 1e9 << " GFLOP/s, "
+                      << "communication " << 100 * a.comm_time() / (a.comm_time() + a.compute_time())
+                      << "%, max relative error " << err << "\n";
+        }
+    }
+    MPI_Finalize();
+    return 0;
+}
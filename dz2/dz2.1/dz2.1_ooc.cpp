@@ -0,0 +1,122 @@
+#include <iostream>
+#include <vector>
+#include <string>
+#include <cstdlib>
+#include <cmath>
+#include <omp.h>
+
+#include "../../common/ooc_matrix.h"
+
+// Умножение матрицы на вектор из dz2.1 (a[i][j] = i + j, b[j] = j) для матрицы, которая
+// не помещается в память: матрица лежит на диске полосами строк и читается по одной полосе,
+// пока считается предыдущая. В памяти - две полосы, b и результат.
+//
+// g++ -std=c++20 -O3 -fopenmp dz2.1_ooc.cpp -o dz2.1_ooc
+// ./dz2.1_ooc create matrix.bin n [m] [tile_rows]
+// ./dz2.1_ooc run matrix.bin [mmap|uring|pread|all] [--direct] [--cached]
+//   --direct - O_DIRECT для uring и pread; --cached - не сбрасывать файл из кэша перед прогоном
+
+void multiply_panel(const double* a, const std::vector<double>& b, double* res, uint64_t rows) {
+    size_t m = b.size();
+    const double* x = b.data();
+    #pragma omp parallel for schedule(static)
+    for (uint64_t r = 0; r < rows; ++r) {
+        const double* row = a + r * m;
+        double sum = 0.0;
+        #pragma omp simd reduction(+:sum)
+        for (size_t j = 0; j < m; ++j)
+            sum += row[j] * x[j];
+        res[r] = sum;
+    }
+}
+
+// Скорость сравнивается с чтением тем же источником без вычислений: mmap с mmap,
+// io_uring с O_DIRECT с io_uring с O_DIRECT. Чтение мерится до и после прогона и берется
+// лучшее: в виртуальной машине первое чтение после сброса кэша медленнее из-за кэша хоста
+void run(const TiledMatrixFile& file, TileSource source, bool direct, bool cached) {
+    auto measure_raw = [&] {
+        if (!cached) drop_file_cache(file.file_path());
+        return raw_read_speed(file, source, direct);
+    };
+    double raw_speed = measure_raw();
+
+    uint64_t n = file.rows(), m = file.cols();
+    std::vector<double> b(m), res(n);
+    for (uint64_t j = 0; j < m; ++j)
+        b[j] = double(j);
+
+    if (!cached) drop_file_cache(file.file_path());
+    double compute = 0.0;
+    double t = omp_get_wtime();
+    stream_panels(file, source, direct, [&](uint64_t k, const double* a, uint64_t rows) {
+        double t0 = omp_get_wtime();
+        multiply_panel(a, b, &res[k * file.tile_rows()], rows);
+        compute += omp_get_wtime() - t0;
+    });
+    t = omp_get_wtime() - t;
+    raw_speed = std::max(raw_speed, measure_raw());
+
+    // res[i] = sum_j (i + j) j = i S1 + S2
+    double s1 = double(m) * (m - 1) / 2, s2 = double(m - 1) * m * (2 * m - 1) / 6;
+    double err = 0.0;
+    for (uint64_t i = 0; i < n; ++i)
+        err = std::max(err, std::fabs(res[i] - (i * s1 + s2)) / (i * s1 + s2));
+
+    double speed = file.file_bytes() / t;
+    std::cout << tile_source_name(source) << (direct && source != TileSource::Mmap ? " (O_DIRECT)" : "")
+              << ": time " << t << " s, " << speed / 1e9 << " GB/s (read only " << raw_speed / 1e9 << " GB/s, "
+              << 100 * speed / raw_speed << "%), compute " << 100 * compute / t << "%, max relative error " << err << "\n";
+}
+
+int main(int argc, char** argv) {
+    if (argc < 3) {
+        std::cerr << "Usage: " << argv[0] << " create <file> <n> [m] [tile_rows]\n"
+                  << "       " << argv[0] << " run <file> [mmap|uring|pread|all] [--direct] [--cached]\n";
+        return 1;
+    }
+    try {
+        std::string mode = argv[1];
+        if (mode == "create") {
+            uint64_t n = argc > 3 ? std::atoll(argv[3]) : 40000;
+            uint64_t m = argc > 4 ? std::atoll(argv[4]) : n;
+            // По умолчанию полоса около 64 МБ
+            uint64_t tile_rows = argc > 5 ? std::atoll(argv[5]) : std::max<uint64_t>(1, (64 << 20) / (m * sizeof(double)));
+            double t = omp_get_wtime();
+            TiledMatrixWriter::create(argv[2], n, m, tile_rows, [](uint64_t i, uint64_t j) { return double(i + j); });
+            TiledMatrixFile file(argv[2]);
+            std::cout << n << "x" << m << ", " << file.panels() << " panels of " << tile_rows << " rows, "
+                      << file.file_bytes() / 1e9 << " GB written in " << omp_get_wtime() - t << " s\n";
+            return 0;
+        }
+
+        TiledMatrixFile file(argv[2]);
+        std::string sources = "all";
+        bool direct = false, cached = false;
+        for (int k = 3; k < argc; ++k) {
+            std::string arg = argv[k];
+            if (arg == "--direct") direct = true;
+            else if (arg == "--cached") cached = true;
+            else sources = arg;
+        }
+
+        std::cout << file.rows() << "x" << file.cols() << ", " << file.file_bytes() / 1e9 << " GB, "
+                  << file.panels() << " panels, " << omp_get_max_threads() << " threads\n";
+
+        if (sources == "mmap" || sources == "all")
+            run(file, TileSource::Mmap, direct, cached);
+        if (sources == "uring" || sources == "all") {
+            try {
+                run(file, TileSource::Uring, direct, cached);
+            } catch (const std::exception& e) {
+                std::cout << "io_uring: " << e.what() << ", falling back to pread\n";
+                if (sources == "uring") run(file, TileSource::Pread, direct, cached);
+            }
+        }
+        if (sources == "pread" || sources == "all")
+            run(file, TileSource::Pread, direct, cached);
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << '\n';
+        return 1;
+    }
+    return 0;
+}
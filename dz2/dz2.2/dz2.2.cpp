@@ -3,6 +3,8 @@
 #include <omp.h>
 #include <cmath>
 
+#include "../../common/trace.h"
+
 int nsteps = 40000000;
 int THREADS = 1;
 double a = -4.0, b = 4.0;
@@ -37,6 +39,7 @@ double integrate_parallel()
 
     #pragma omp parallel num_threads(THREADS)
     {
+        TRACE_SCOPE("integrate");
         int nthreads = omp_get_num_threads();
         int threadid = omp_get_thread_num();
         int items_per_thread = nsteps / nthreads;
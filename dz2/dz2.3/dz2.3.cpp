@@ -4,8 +4,14 @@
 #include<cstdlib>
 #include<cstring>
 #include<cmath>
+#include<string>
 #include <omp.h>
 
+#include "../../common/matrix_file.h"
+#include "../../common/trace.h"
+#include "solver.h"
+#include "symmetric.h"
+
 double norm(std::vector<double> v, int n) {
     double sum = 0.0;
     for (int i = 0; i < n; ++i) {
@@ -14,13 +20,19 @@ double norm(std::vector<double> v, int n) {
     return sqrt(sum);
 }
 
+// Вызывается всеми потоками параллельной области; сумма общая, барьер в конце не дает
+// следующему вызову обнулить ее, пока кто-то еще читает
 double norm1(std::vector<double> v, int n) {
-    double sum = 0.0;
+    static double sum;
+    #pragma omp single
+    sum = 0.0;
     #pragma omp for reduction(+:sum)
     for (int i = 0; i < n; ++i) {
         sum += v[i] * v[i];
     }
-    return sqrt(sum);
+    double result = sqrt(sum);
+    #pragma omp barrier
+    return result;
 }
 
 
@@ -76,13 +88,17 @@ double solve_parallel_1(std::vector<double> a, std::vector<double> b, int n, int
         std::vector<double> Ax(n, 0.0);
         std::vector<double> residual(n);
 
-        #pragma omp parallel for schedule(static)
-        for (int i = 0; i < n; ++i) {
-            double temp = 0.0;
-            for (int j = 0; j < n; ++j) {
-                temp += a[i * n + j] * x_cur[j];
+        #pragma omp parallel
+        {
+            TRACE_SCOPE("matvec");
+            #pragma omp for schedule(static)
+            for (int i = 0; i < n; ++i) {
+                double temp = 0.0;
+                for (int j = 0; j < n; ++j) {
+                    temp += a[i * n + j] * x_cur[j];
+                }
+                Ax[i] = temp;
             }
-            Ax[i] = temp;
         }
 
         #pragma omp parallel for schedule(static)
@@ -125,6 +141,7 @@ double solve_parallel_2(std::vector<double> a, std::vector<double> b, int n, int
     double t = omp_get_wtime();
     #pragma omp parallel
     for (int iter = 0; iter < iterations; ++iter) {
+        TRACE_SCOPE("iteration");
         std::vector<double> Ax(n, 0.0);
         std::vector<double> residual(n);
 
@@ -158,7 +175,113 @@ double solve_parallel_2(std::vector<double> a, std::vector<double> b, int n, int
     return t;
 }
 
-int main() {
+// Тот же метод на упакованной симметричной матрице
+double solve_packed(const SymmetricMatrix& a, const std::vector<double>& b, int iterations, double eps, const double r, int nthreads) {
+    omp_set_num_threads(nthreads);
+    std::vector<double> x(b.size(), 0.0);
+    auto matvec = [&](const std::vector<double>& in, std::vector<double>& out) {
+        TRACE_SCOPE("symv");
+        a.symv(in, out);
+    };
+    auto dot = [](const std::vector<double>& u, const std::vector<double>& v) {
+        double sum = 0.0;
+        #pragma omp parallel for reduction(+:sum) schedule(static)
+        for (size_t i = 0; i < u.size(); ++i)
+            sum += u[i] * v[i];
+        return sum;
+    };
+
+    double t = omp_get_wtime();
+    SolveResult res = solve_simple_iteration(matvec, dot, b, x, iterations, eps, r);
+    t = omp_get_wtime() - t;
+
+    std::cout << x[0] << std::endl;
+    std::cout << "Solution take " << t << " seconds (" << res.iterations << " iterations).\n";
+    return t;
+}
+
+// Сравнение symv с плотным умножением на случайном векторе
+bool check_symv(const std::vector<double>& a, const SymmetricMatrix& packed, int n) {
+    std::vector<double> x(n), y_dense(n), y_packed;
+    for (int i = 0; i < n; ++i)
+        x[i] = std::rand() / double(RAND_MAX) - 0.5;
+    for (int i = 0; i < n; ++i) {
+        double sum = 0.0;
+        for (int j = 0; j < n; ++j)
+            sum += a[i * n + j] * x[j];
+        y_dense[i] = sum;
+    }
+    packed.symv(x, y_packed);
+    double err = 0.0, scale = 0.0;
+    for (int i = 0; i < n; ++i) {
+        err = std::max(err, std::fabs(y_dense[i] - y_packed[i]));
+        scale = std::max(scale, std::fabs(y_dense[i]));
+    }
+    bool ok = err <= 1e-12 * scale * n;
+    std::cout << "symv vs dense: max error " << err << " (scale " << scale << ") " << (ok ? "OK" : "FAILED") << "\n";
+    return ok;
+}
+
+// ./dz2.3 packed [n] - проверка и сравнение плотного и упакованного хранения
+int packed_mode(int n) {
+    std::vector<double> a(size_t(n) * n);
+    std::vector<double> b(n, n + 1);
+    for (int i = 0; i < n; i++)
+        for (int j = 0; j < n; j++)
+            a[i * n + j] = i == j ? 2.0 : 1.0;
+    SymmetricMatrix packed(n);
+    packed.fill([](size_t i, size_t j) { return i == j ? 2.0 : 1.0; });
+
+    // Проверка на несимметричных по значениям элементах, чтобы перепутанные i и j были видны
+    std::vector<double> a_test(size_t(n) * n);
+    SymmetricMatrix packed_test(n);
+    auto value = [](size_t i, size_t j) { return 1.0 / (1.0 + std::min(i, j)) + 0.001 * std::max(i, j); };
+    for (int i = 0; i < n; i++)
+        for (int j = 0; j < n; j++)
+            a_test[i * n + j] = value(i, j);
+    packed_test.fill(value);
+    if (!check_symv(a_test, packed_test, n))
+        return 1;
+
+    int nthreads = omp_get_max_threads();
+    std::cout << "dense: " << a.size() * sizeof(double) / 1e6 << " MB\n";
+    double t_dense = solve_parallel_1(a, b, n, 12000, 1e-05, 0.001, nthreads);
+    std::cout << "packed: " << packed.bytes() / 1e6 << " MB\n";
+    double t_packed = solve_packed(packed, b, 12000, 1e-05, 0.001, nthreads);
+    std::cout << "speedup " << t_dense / t_packed << "\n";
+    return 0;
+}
+
+// Система из файлов matrix_tool: ./dz2.3 file A.dzm b.dzm
+int file_mode(const char* a_path, const char* b_path) {
+    try {
+        MappedMatrix a_file(a_path), b_file(b_path);
+        if (a_file.kind() != MatrixKind::Dense || a_file.layout() != MatrixLayout::RowMajor
+            || a_file.rows() != a_file.cols() || b_file.kind() != MatrixKind::Vector
+            || b_file.rows() != a_file.rows())
+            throw std::runtime_error("Expected a square row-major dense matrix and a vector of matching size");
+        if (a_file.rows() > 46340)  // n * n должно помещаться в int
+            throw std::runtime_error("Matrix is too large: " + std::to_string(a_file.rows()));
+        int n = static_cast<int>(a_file.rows());
+        const double* a_values = a_file.values<double>();
+        const double* b_values = b_file.values<double>();
+        std::vector<double> a(a_values, a_values + size_t(n) * n);
+        std::vector<double> b(b_values, b_values + n);
+        std::cout << "Starting to compute...\n";
+        std::cout << solve_parallel_2(a, b, n, 12000, 1e-05, 0.001, omp_get_max_threads()) << "\n";
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << "\n";
+        return 1;
+    }
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    if (argc > 1 && std::string(argv[1]) == "packed")
+        return packed_mode(argc > 2 ? std::atoi(argv[2]) : 1998);
+    if (argc > 3 && std::string(argv[1]) == "file")
+        return file_mode(argv[2], argv[3]);
+
     int n = 1998;
 
     std::vector<double> a(n*n);
@@ -0,0 +1,91 @@
+#include <iostream>
+#include <vector>
+#include <cstdlib>
+#include <string>
+#include <memory>
+#include <mpi.h>
+#include <omp.h>
+
+#include "../../common/matrix_file.h"
+#include "../../common/mpi_gemv.h"
+#include "solver.h"
+
+// Решение той же системы, что в dz2.3.cpp (2 на диагонали, 1 вне ее, b = n + 1,
+// решение - единичный вектор), с распределенным по процессам умножением.
+// Внутри процесса умножение и обновление x распараллелены OpenMP (OMP_NUM_THREADS).
+//
+// mpicxx -std=c++20 -O3 -fopenmp dz2.3_mpi.cpp -o dz2.3_mpi
+// OMP_NUM_THREADS=2 mpirun -np 4 ./dz2.3_mpi [n] [grid_cols]   (grid_cols 0 - двумерная решетка)
+// mpirun -np 4 ./dz2.3_mpi 0 [grid_cols] A.dzm b.dzm   система из файлов matrix_tool; каждый
+//   процесс читает из отображения только свой блок
+
+int main(int argc, char** argv) {
+    int provided;
+    MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &provided);
+    int rank, nprocs;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &nprocs);
+
+    long n = argc > 1 ? std::atol(argv[1]) : 1998;
+    int grid_cols = argc > 2 ? std::atoi(argv[2]) : 1;
+    std::unique_ptr<MappedMatrix> a_file, b_file;
+    if (argc > 4) {
+        try {
+            a_file = std::make_unique<MappedMatrix>(argv[3]);
+            b_file = std::make_unique<MappedMatrix>(argv[4]);
+            if (a_file->kind() != MatrixKind::Dense || a_file->layout() != MatrixLayout::RowMajor
+                || a_file->rows() != a_file->cols() || b_file->kind() != MatrixKind::Vector
+                || b_file->rows() != a_file->rows())
+                throw std::runtime_error("Expected a square row-major dense matrix and a vector of matching size");
+        } catch (const std::exception& e) {
+            if (rank == 0) std::cerr << e.what() << "\n";
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+        n = static_cast<long>(a_file->rows());
+    }
+    {
+        std::unique_ptr<DistributedMatrix> a_ptr;
+        try {
+            a_ptr = std::make_unique<DistributedMatrix>(n, n, MPI_COMM_WORLD, grid_cols);
+        } catch (const std::exception& e) {
+            if (rank == 0) std::cerr << e.what() << "\n";
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+        DistributedMatrix& a = *a_ptr;
+        std::vector<double> b(a.y_count(), double(n + 1));
+        if (a_file) {
+            const double* values = a_file->values<double>();
+            a.fill([&](long i, long j) { return values[i * n + j]; });
+            std::copy_n(b_file->values<double>() + a.y_offset(), a.y_count(), b.begin());
+        } else {
+            a.fill([](long i, long j) { return i == j ? 2.0 : 1.0; });
+        }
+        std::vector<double> x(a.x_count(), 0.0);
+        auto matvec = [&](const std::vector<double>& in, std::vector<double>& out) { a.gemv(in, out); };
+        auto dot = [&](const std::vector<double>& u, const std::vector<double>& v) {
+            return distributed_dot(u, v, MPI_COMM_WORLD);
+        };
+
+        MPI_Barrier(MPI_COMM_WORLD);
+        double t = MPI_Wtime();
+        SolveResult res = solve_simple_iteration(matvec, dot, b, x, 12000, 1e-05, 0.001);
+        t = MPI_Wtime() - t;
+
+        // Отклонение от точного решения (единицы; для системы из файла - если она той же формы)
+        double local_dev = 0.0;
+        for (double v : x) local_dev = std::max(local_dev, std::fabs(v - 1.0));
+        double dev = 0.0;
+        MPI_Reduce(&local_dev, &dev, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+
+        if (rank == 0) {
+            std::cout << nprocs << " processes (" << a.grid_rows() << "x" << a.grid_cols() << "), "
+                      << omp_get_max_threads() << " threads each\n";
+            std::cout << "iterations " << res.iterations << ", residual " << res.error
+                      << ", max |x - 1| " << dev << "\n";
+            std::cout << "Solution take " << t << " seconds (communication " << a.comm_time()
+                      << ", matvec " << a.compute_time() << ").\n";
+        }
+    }
+    MPI_Finalize();
+    return 0;
+}
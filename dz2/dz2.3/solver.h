@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cmath>
+#include <vector>
+
+// Метод простой итерации x = x - r (A x - b), как в solve_parallel_1/2, но без привязки
+// к способу умножения: matvec(x, y) считает y = A x, dot(u, v) - скалярное произведение.
+// При распределенном умножении все векторы - отрезки этого процесса, а dot складывает
+// частичные суммы всех процессов.
+
+struct SolveResult {
+    int iterations;
+    double error;  // ||A x - b|| / ||b|| на последней итерации
+};
+
+template <typename MatVec, typename Dot>
+SolveResult solve_simple_iteration(MatVec matvec, Dot dot, const std::vector<double>& b, std::vector<double>& x,
+                                   int iterations, double eps, double r) {
+    size_t n = b.size();
+    std::vector<double> x_new(n), Ax(n), residual(n);
+    double norm_b = std::sqrt(dot(b, b));
+    SolveResult result{0, 0.0};
+
+    for (int iter = 0; iter < iterations; ++iter) {
+        matvec(x, Ax);
+        #pragma omp parallel for schedule(static)
+        for (size_t i = 0; i < n; ++i) {
+            residual[i] = Ax[i] - b[i];
+            x_new[i] = x[i] - r * residual[i];
+        }
+        result.iterations = iter + 1;
+        result.error = std::sqrt(dot(residual, residual)) / norm_b;
+        x.swap(x_new);
+        if (result.error < eps)
+            break;
+    }
+    return result;
+}
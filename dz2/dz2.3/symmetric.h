@@ -0,0 +1,101 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+#include <omp.h>
+
+// Симметричная матрица в упакованном виде: хранится только верхний треугольник по строкам,
+// строка i - элементы a[i][i..n-1]. Памяти n (n + 1) / 2 вместо n^2.
+//
+// Умножение y = A x читает каждый элемент один раз и использует его для двух строк:
+// a[i][j] x[j] идет в y[i], a[i][j] x[i] - в y[j]. Вторая часть пишет в чужие строки,
+// поэтому у каждого потока свой буфер y, который в конце складывается. Строки делятся
+// между потоками по числу элементов (верхние строки длиннее), а буфер потока начинается
+// с его первой строки: ниже он ничего не пишет.
+
+class SymmetricMatrix {
+public:
+    explicit SymmetricMatrix(size_t n) : n(n), a(n * (n + 1) / 2) {}
+
+    // fn(i, j) для i <= j
+    template <typename Fn>
+    void fill(Fn fn) {
+        #pragma omp parallel for schedule(dynamic, 16)
+        for (size_t i = 0; i < n; ++i) {
+            double* row = &a[offset(i)];
+            for (size_t j = i; j < n; ++j)
+                row[j - i] = fn(i, j);
+        }
+    }
+
+    double operator()(size_t i, size_t j) const { return i <= j ? a[offset(i) + j - i] : a[offset(j) + i - j]; }
+
+    size_t size() const { return n; }
+    size_t bytes() const { return a.size() * sizeof(double); }
+
+    void symv(const std::vector<double>& x, std::vector<double>& y) const {
+        y.resize(n);
+        // Границы и буферы свои у каждого вызова: symv можно звать из нескольких потоков сразу
+        std::vector<size_t> bounds;
+        std::vector<std::vector<double>> partial;
+        #pragma omp parallel
+        {
+            int nthreads = omp_get_num_threads();
+            int t = omp_get_thread_num();
+            #pragma omp single
+            {
+                bounds = partition(nthreads);
+                partial.resize(nthreads);
+            }
+            size_t lb = bounds[t], ub = bounds[t + 1];
+            std::vector<double>& acc = partial[t];
+            acc.assign(n - lb, 0.0);
+            double* yt = acc.data();  // yt[j - lb] для j >= lb
+            const double* xp = x.data();
+
+            for (size_t i = lb; i < ub; ++i) {
+                const double* row = &a[offset(i)];
+                double xi = xp[i];
+                double sum = row[0] * xi;
+                #pragma omp simd reduction(+:sum)
+                for (size_t j = i + 1; j < n; ++j) {
+                    sum += row[j - i] * xp[j];
+                    yt[j - lb] += row[j - i] * xi;
+                }
+                yt[i - lb] += sum;
+            }
+            #pragma omp barrier
+
+            // y[i] - сумма буферов потоков, чья первая строка не ниже i
+            #pragma omp for schedule(static)
+            for (size_t i = 0; i < n; ++i) {
+                double sum = 0.0;
+                for (int k = 0; k < nthreads && bounds[k] <= i; ++k)
+                    sum += partial[k][i - bounds[k]];
+                y[i] = sum;
+            }
+        }
+    }
+
+private:
+    size_t offset(size_t i) const { return i * n - i * (i - 1) / 2; }
+
+    // Границы строк потоков с равным числом элементов
+    std::vector<size_t> partition(int nthreads) const {
+        std::vector<size_t> bounds(nthreads + 1, n);
+        bounds[0] = 0;
+        double total = double(n) * (n + 1) / 2;
+        size_t i = 0;
+        double done = 0.0;
+        for (int k = 1; k < nthreads; ++k) {
+            double target = total * k / nthreads;
+            while (i < n && done + (n - i) <= target) done += n - i++;
+            bounds[k] = i;
+        }
+        return bounds;
+    }
+
+    size_t n;
+    std::vector<double> a;
+};
@@ -2,12 +2,22 @@
 #include <fstream>
 #include<vector>
 #include <thread>
+#include <barrier>
 #include<chrono>
+#include <cstdlib>
+#include <cmath>
 
+#include "../../common/gemv.h"
 
-void initializeMatrix(std::vector<double>& a, int m, int n, int low_bound, int up_bound) {
-    for (int i = low_bound; i < up_bound; i++) {
-        for (int j = 0; j < n; j++) {
+// g++ -std=c++20 -O3 -fopenmp dz3.1.cpp -o dz3.1
+// ./dz3.1 [m] [n] [nthreads]   матрица m x n, по умолчанию 20000 x 20000 и 40 потоков
+//
+// Потоки делят матрицу решеткой из gemv.h: при малом числе строк делятся и столбцы,
+// частичные суммы складываются деревом.
+
+void initializeMatrix(std::vector<double>& a, int n, GemvBlock blk) {
+    for (size_t i = blk.r0; i < blk.r1; i++) {
+        for (size_t j = blk.c0; j < blk.c1; j++) {
             a[i * n + j] = i + j;
         }
     }
@@ -20,38 +30,49 @@ void initializeVector(std::vector<double>& b, int n) {
     }
 }
 
-void matrix_vector_product_threads(std::vector<double>& a, std::vector<double>& b, std::vector<double>& c, int low_bound, int up_bound, int n) {
-    for (int i = low_bound; i < up_bound; i++) {
-        c[i] = 0.0;
-        for (int j = 0; j < n; j++) {
-            c[i] += a[i * n + j] * b[j];
+// Свой блок в partial, затем дерево по столбцам решетки: на шаге s поток bj прибавляет буфер bj + s
+void matrix_vector_product_threads(std::vector<double>& a, std::vector<double>& b, std::vector<double>& c,
+                                   std::vector<std::vector<double>>& partial, std::barrier<>& sync,
+                                   GemvPartition part, int threadid, int m, int n) {
+    GemvBlock blk = part.block(threadid, m, n);
+    std::vector<double>& out = partial[threadid];
+    out.assign(blk.r1 - blk.r0, 0.0);
+    for (size_t i = blk.r0; i < blk.r1; i++) {
+        double sum = 0.0;
+        for (size_t j = blk.c0; j < blk.c1; j++) {
+            sum += a[i * n + j] * b[j];
         }
+        out[i - blk.r0] = sum;
     }
 
+    int bj = threadid % part.pc;
+    for (int s = 1; s < part.pc; s *= 2) {
+        sync.arrive_and_wait();
+        if (bj % (2 * s) == 0 && bj + s < part.pc) {
+            const std::vector<double>& src = partial[threadid + s];
+            for (size_t i = 0; i < out.size(); i++)
+                out[i] += src[i];
+        }
+    }
+    if (bj == 0)
+        std::copy(out.begin(), out.end(), c.begin() + blk.r0);
 }
 
-int main() {
+int main(int argc, char** argv) {
     //1,2,4,7,8,16,20,40
-    int nthreads = 40;
-    int m = 20000;
-    int n = 20000;
-    std::vector<double> a;//инициализация происходит сразу надо исправить
-    a.reserve(m*n);
-    std::vector<double> b;
-    b.reserve(n);
-    std::vector<double> c;
-    c.reserve(m);
-
+    int nthreads = argc > 3 ? std::atoi(argv[3]) : 40;
+    int m = argc > 1 ? std::atoi(argv[1]) : 20000;
+    int n = argc > 2 ? std::atoi(argv[2]) : 20000;
+    std::vector<double> a(size_t(m) * n);
+    std::vector<double> b(n);
+    std::vector<double> c(m);
+
+    GemvPartition part = choose_partition(m, n, nthreads);
     std::vector<std::thread> threads;
 
-    // Параллельная инициализация матрицы A
+    // Параллельная инициализация матрицы A тем же разбиением, что и умножение
     for (int i = 0; i < nthreads; ++i) {
-        int threadid = i;
-        int items_per_thread = m / nthreads;
-        int low_bound = threadid * items_per_thread;
-        int up_bound = (threadid == nthreads - 1) ? (m - 1) : (low_bound + items_per_thread - 1);
-
-        threads.emplace_back(initializeMatrix, std::ref(a), m, n, low_bound, up_bound);
+        threads.emplace_back(initializeMatrix, std::ref(a), n, part.block(i, m, n));
     }
 
     // Запускаем отдельный поток для вектора B
@@ -65,16 +86,15 @@ int main() {
 
     threads.clear();
 
+    std::vector<std::vector<double>> partial(nthreads);
+    std::barrier<> sync(nthreads);
+
     // Засекли время
     std::chrono::steady_clock::time_point t1 = std::chrono::steady_clock::now();
 
     for(int i = 0; i < nthreads; ++i){
-        int threadid = i;
-        int items_per_thread = m / nthreads;
-        int low_bound = threadid * items_per_thread;
-        int up_bound = (threadid == nthreads - 1) ? (m - 1) : (low_bound + items_per_thread - 1);
-
-        threads.emplace_back(matrix_vector_product_threads, std::ref(a), std::ref(b), std::ref(c), low_bound, up_bound, n);
+        threads.emplace_back(matrix_vector_product_threads, std::ref(a), std::ref(b), std::ref(c), std::ref(partial),
+                             std::ref(sync), part, i, m, n);
     }
 
     for (auto& thread : threads) {
@@ -84,10 +104,17 @@ int main() {
     std::chrono::steady_clock::time_point t2 = std::chrono::steady_clock::now();
     std::chrono::duration<double> t = std::chrono::duration_cast<std::chrono::duration<double>>(t2 - t1);
 
+    // c[i] = sum_j (i + j) j = i S1 + S2
+    double s1 = double(n) * (n - 1) / 2, s2 = double(n - 1) * n * (2.0 * n - 1) / 6, err = 0.0;
+    for (int i = 0; i < m; i++)
+        err = std::max(err, std::abs(c[i] - (i * s1 + s2)) / (i * s1 + s2));
+    std::cout << m << "x" << n << ", " << nthreads << " threads (" << part.pr << "x" << part.pc << "): "
+              << t.count() << " s, max relative error " << err << "\n";
+
     std::ofstream out;
     out.open("MyRes.txt", std::ios::app);
     out << t.count() << ", ";
     out.close();
 
     return 0;
-}
\ No newline at end of file
+}
@@ -1,169 +1,779 @@
+// g++ -std=c++20 -O3 -fopenmp -ffast-math dz3.2.1.cpp -o dz3.2.1
+// -ffast-math нужен пакетным ядрам server.h (векторные sin/pow из libmvec)
+
 #include <iostream>
 #include <fstream>
-#include <queue>
-#include <future>
 #include <thread>
 #include <chrono>
 #include <cmath>
 #include <functional>
-#include <mutex>
-#include <condition_variable>
-#include <unordered_map>
-#include <optional>
+#include <vector>
+#include <deque>
+#include <atomic>
+#include <latch>
+#include <string>
+#include <cstdio>
+#include <cstdint>
+#include <bit>
 #include <experimental/random>
 
+#include <sys/resource.h>
+
+#include "server.h"
+#include "result_writer.h"
+#include "result_format.h"
+#include "stream_verify.h"
+
 #define myType double
 
 std::mutex cout_mutex; 
 
-template<typename T>
-T fun_sin(T arg) {
-    return std::sin(arg);
+// С -ffast-math std::isnan всегда false, поэтому проверка по битам
+bool is_nan(double v) {
+    return (std::bit_cast<uint64_t>(v) & ~(uint64_t(1) << 63)) > 0x7ff0000000000000ull;
 }
 
-template<typename T>
-T fun_sqrt(T arg) {
-    return std::sqrt(arg);
-}
+void add_task1_thread(Server<myType>& server) {
+    ResultFile file("Task1.txt");
+    auto out = file.writer();
+    ResultWriter bin("Task1.bin", true);
+    for(int i = 0; i < 10000; ++i)
+    {    
+        double arg = std::experimental::randint(0, 100);
+        size_t task_id = server.add_task(std::bind(fun_sin<myType>, arg));
 
-template<typename T>
-T fun_pow(T x, T y) {
-    return std::pow(x, y);
+        myType result = server.request_result(task_id);
+        out << "sin " << arg << " = " << result << '\n';
+        bin.add(ResultOp::Sin, arg, 0.0, result);
+    }
 }
 
+void add_task2_thread(Server<myType>& server) {
+    ResultFile file("Task2.txt");
+    auto out = file.writer();
+    ResultWriter bin("Task2.bin", true);
+    for(int i = 0; i < 10000; ++i)
+    {    
+        double arg = std::experimental::randint(0, 100);
+        size_t task_id = server.add_task(std::bind(fun_sqrt<myType>, arg));
 
-template <typename T>
-class Server {
-public:
-    Server() {}
+        myType result = server.request_result(task_id);
+        out << "sqrt " << arg << " = " << result << '\n';
+        bin.add(ResultOp::Sqrt, arg, 0.0, result);
+    }
+}
 
-    ~Server() {
-        stop();
-        {
-            std::lock_guard<std::mutex> lock(result_mutex);
-            results.clear();
-        }
+void add_task3_thread(Server<myType>& server) {
+    ResultFile file("Task3.txt");
+    auto out = file.writer();
+    ResultWriter bin("Task3.bin", true);
+    for(int i = 0; i < 10000; ++i)
+    {    
+        double arg1 = std::experimental::randint(0, 100);
+        double arg2 = std::experimental::randint(0, 20);
+        size_t task_id = server.add_task(std::bind(fun_pow<myType>, arg1, arg2));
+
+        myType result = server.request_result(task_id);
+        out << "pow " << arg1 << " " <<  arg2 << " = " << result << '\n';
+        bin.add(ResultOp::Pow, arg1, arg2, result);
     }
+}
+
+// Сравнение пропускной способности замыканий и типизированных запросов на нагрузке Task1-3.
+// Клиент сначала отправляет все запросы, затем собирает результаты, чтобы воркеру было что склеивать
+template<typename Submit>
+double bench_workload(Server<myType>& server, int ntasks, Submit submit) {
+    std::vector<size_t> ids(ntasks);
+    auto t1 = std::chrono::steady_clock::now();
+    for (int i = 0; i < ntasks; ++i)
+        ids[i] = submit(i);
+    double checksum = 0.0;
+    for (int i = 0; i < ntasks; ++i)
+        checksum += server.request_result(ids[i]);
+    auto t2 = std::chrono::steady_clock::now();
+    std::chrono::duration<double> t = t2 - t1;
+    if (is_nan(checksum))
+        std::cerr << "NaN in results\n";
+    return ntasks / t.count();
+}
 
-    void start() {
-        server_thread = std::jthread(&Server::server_loop, this, stop_src.get_token());
+void bench_ops(size_t nworkers) {
+    const int ntasks = 100000;
+    std::vector<double> arg1(ntasks), arg2(ntasks);
+    for (int i = 0; i < ntasks; ++i) {
+        arg1[i] = std::experimental::randint(0, 100);
+        arg2[i] = std::experimental::randint(0, 20);
     }
 
-    void stop() {
-        stop_src.request_stop();
-        cond_var.notify_one();
-        if (server_thread.joinable()) {
-            server_thread.join();
+    Server<myType> server(nworkers);
+    server.start();
+    Server<myType> memo_server(nworkers);
+    memo_server.enable_memo(1 << 16);
+    memo_server.start();
+
+    const char* names[] = {"sin", "sqrt", "pow"};
+    for (int k = 0; k < 3; ++k) {
+        Op op = static_cast<Op>(k);
+        double closure = bench_workload(server, ntasks, [&](int i) {
+            switch (op) {
+                case Op::Sin:  return server.add_task(std::bind(fun_sin<myType>, arg1[i]));
+                case Op::Sqrt: return server.add_task(std::bind(fun_sqrt<myType>, arg1[i]));
+                default:       return server.add_task(std::bind(fun_pow<myType>, arg1[i], arg2[i]));
+            }
+        });
+        double typed = bench_workload(server, ntasks, [&](int i) {
+            return server.add_op(op, arg1[i], arg2[i]);
+        });
+        // Первый проход прогревает кэш, меряем второй
+        double memoized = 0.0;
+        for (int pass = 0; pass < 2; ++pass) {
+            memoized = bench_workload(memo_server, ntasks, [&](int i) {
+                return memo_server.add_op(op, arg1[i], arg2[i]);
+            });
         }
+        std::cout << names[k] << ": closure " << closure << " ops/s, typed " << typed
+                  << " ops/s, typed+memo (warm) " << memoized << " ops/s, speedup " << typed / closure
+                  << "\n";
     }
+    std::cout << "memo: " << memo_server.memo_hits() << " hits, "
+              << memo_server.memo_misses() << " misses\n";
+    server.stop();
+    memo_server.stop();
+}
 
-    size_t add_task(std::function<double()> task) {
-        size_t task_id = task_counter++;
-        std::packaged_task<T()> packaged_task(std::move(task));
-        std::future<T> result = packaged_task.get_future();
-        {
-            std::lock_guard<std::mutex> lock(queue_mutex);
-            tasks.emplace(task_id, std::move(packaged_task));
-        }
-        {
-            std::lock_guard<std::mutex> lock(result_mutex);
-            results[task_id] = std::move(result);
-        }
-        cond_var.notify_one();
-        return task_id;
+ClientTask coro_client(Server<myType>& server, Scheduler& scheduler, int requests,
+                       std::atomic<double>& checksum, std::latch& done) {
+    double sum = 0.0;
+    for (int i = 0; i < requests; ++i) {
+        double arg = std::experimental::randint(0, 100);
+        sum += co_await server.submit(std::bind(fun_sin<myType>, arg), &scheduler);
     }
+    checksum.fetch_add(sum);
+    done.count_down();
+}
 
+// 10k логических клиентов: корутины на нескольких потоках против потока на клиента
+void bench_coro(int nclients, size_t nthreads) {
+    const int requests = 10;
+    Server<myType> server;
+    server.start();
 
-    double request_result(size_t task_id) {
-        std::unique_lock<std::mutex> lock(result_mutex);
-        auto it = results.find(task_id);
+    std::atomic<double> checksum{0.0};
+    auto t1 = std::chrono::steady_clock::now();
+    {
+        Scheduler scheduler(nthreads);
+        std::latch done(nclients);
+        for (int i = 0; i < nclients; ++i)
+            spawn(scheduler, coro_client(server, scheduler, requests, checksum, done));
+        done.wait();
+    }
+    auto t2 = std::chrono::steady_clock::now();
+    std::chrono::duration<double> coro_time = t2 - t1;
+    std::cout << "coroutines: " << nclients << " clients on " << nthreads << " threads, "
+              << coro_time.count() << " s, " << nclients * requests / coro_time.count() << " req/s\n";
+
+    t1 = std::chrono::steady_clock::now();
+    std::vector<std::thread> clients;
+    try {
+        for (int i = 0; i < nclients; ++i) {
+            clients.emplace_back([&server, &checksum] {
+                double sum = 0.0;
+                for (int k = 0; k < requests; ++k) {
+                    double arg = std::experimental::randint(0, 100);
+                    sum += server.request_result(server.add_task(std::bind(fun_sin<myType>, arg)));
+                }
+                checksum.fetch_add(sum);
+            });
+        }
+    } catch (const std::system_error& e) {
+        std::cerr << "Thread-per-client stopped at " << clients.size() << " threads: " << e.what() << '\n';
+    }
+    for (auto& client : clients)
+        client.join();
+    t2 = std::chrono::steady_clock::now();
+    std::chrono::duration<double> thread_time = t2 - t1;
+    std::cout << "threads: " << clients.size() << " clients, " << thread_time.count() << " s, "
+              << clients.size() * requests / thread_time.count() << " req/s\n";
+    server.stop();
+}
 
-        if (it == results.end()) {
-            throw std::runtime_error("Task ID not found!");
+// Поток дешевых sin в Normal и редкие задержко-критичные запросы: сравниваем их задержку
+// в классе Normal (в общей очереди) и в классе High с дедлайном
+void bench_priority(size_t nworkers) {
+    const int flood_tasks = 200000;
+    const int critical_tasks = 200;
+
+    for (Priority critical : {Priority::Normal, Priority::High}) {
+        Server<myType> server(nworkers);
+        server.start();
+
+        std::atomic<bool> flooding{true};
+        std::thread flood([&] {
+            std::vector<size_t> ids;
+            ids.reserve(flood_tasks);
+            for (int i = 0; i < flood_tasks; ++i)
+                ids.push_back(server.add_task(std::bind(fun_sin<myType>, double(i % 100)), Priority::Low));
+            for (int i = 0; i < flood_tasks; ++i)
+                ids[i] = server.add_task(std::bind(fun_sin<myType>, double(i % 100)));
+            for (size_t id : ids)
+                server.request_result(id);
+            flooding = false;
+        });
+        // Задержку критичных запросов меряем у клиента: в классе Normal серверная гистограмма
+        // смешала бы их с потоком sin
+        LatencyHistogram critical_latency;
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        for (int i = 0; i < critical_tasks && flooding; ++i) {
+            auto submitted = std::chrono::steady_clock::now();
+            size_t id = server.add_task(std::bind(fun_pow<myType>, 2.0, double(i % 20)),
+                                        critical, std::chrono::microseconds(100));
+            server.request_result(id);
+            critical_latency.record(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - submitted).count());
+            std::this_thread::sleep_for(std::chrono::microseconds(200));
         }
-        it->second.wait();
-        return it->second.get();
+        flood.join();
+        server.stop();
+
+        std::cout << "critical requests as " << priority_name(critical) << ": n=" << critical_latency.count()
+                  << " p50=" << critical_latency.percentile(0.5) / 1000.0
+                  << "us p99=" << critical_latency.percentile(0.99) / 1000.0
+                  << "us p999=" << critical_latency.percentile(0.999) / 1000.0 << "us\n";
+        std::cout << "server side, all requests by class:\n";
+        server.print_latency_stats(std::cout);
     }
+}
 
-private:
-    std::jthread server_thread;
-    std::queue<std::pair<size_t, std::packaged_task<T()>>> tasks;
-    std::unordered_map<size_t, std::future<T>> results;
+// Перегрузка: 4 производителя предлагают больше, чем вмещает очередь. Каждый держит не больше
+// WINDOW невостребованных результатов, так что память ограничена емкостью очереди и окнами
+void bench_overload(size_t nworkers) {
+    const size_t capacity = 1000;
+    const int producers = 4;
+    const int per_producer = 50000;
+    const size_t window = 1000;
+    const char* names[] = {"block", "fail-fast", "shed-lowest"};
+
+    for (int k = 0; k < 3; ++k) {
+        Server<myType> server(nworkers, capacity, static_cast<OverflowPolicy>(k));
+        server.start();
+        std::atomic<size_t> lost{0};
+
+        auto t1 = std::chrono::steady_clock::now();
+        std::vector<std::thread> threads;
+        for (int p = 0; p < producers; ++p) {
+            threads.emplace_back([&, p] {
+                std::deque<size_t> pending;
+                auto collect = [&] {
+                    try {
+                        server.request_result(pending.front());
+                    } catch (const std::future_error&) {
+                        lost++;  // задачу вытеснили
+                    }
+                    pending.pop_front();
+                };
+                for (int i = 0; i < per_producer; ++i) {
+                    Priority priority = (i + p) % 4 == 0 ? Priority::Low : Priority::Normal;
+                    size_t id;
+                    SubmitStatus status = SubmitStatus::Ok;
+                    if (k == static_cast<int>(OverflowPolicy::Block))
+                        id = server.add_task(std::bind(fun_sin<myType>, double(i % 100)), priority);
+                    else
+                        status = server.try_add_task(std::bind(fun_sin<myType>, double(i % 100)), id, priority);
+                    if (status == SubmitStatus::Ok)
+                        pending.push_back(id);
+                    if (pending.size() > window)
+                        collect();
+                }
+                while (!pending.empty())
+                    collect();
+            });
+        }
+        for (auto& thread : threads)
+            thread.join();
+        auto t2 = std::chrono::steady_clock::now();
+        server.stop();
+
+        std::chrono::duration<double> t = t2 - t1;
+        std::cout << names[k] << ": " << t.count() << " s, peak depth " << server.peak_queue_depth()
+                  << ", rejected " << server.rejected() << ", shed " << server.shed()
+                  << ", lost " << lost << "\n";
+        server.print_latency_stats(std::cout);
+    }
+}
 
-    std::mutex queue_mutex, result_mutex;
-    std::stop_source stop_src;
-    std::condition_variable cond_var;
-    std::atomic<size_t> task_counter{0};
+// Накладные расходы замеров: пропускная способность sin-задач с включенной и выключенной
+// статистикой воркеров. Берем лучший из нескольких прогонов, чтобы убрать шум
+void bench_stats(size_t nworkers) {
+    const int ntasks = 200000;
+    double best[2] = {0.0, 0.0};
+    for (int rep = 0; rep < 9; ++rep) {
+        for (int enabled = 0; enabled < 2; ++enabled) {
+            Server<myType> server(nworkers);
+            server.enable_stats(enabled);
+            server.start();
+            if (enabled && rep == 0)
+                server.start_stats_dump(std::chrono::milliseconds(100), std::cout);
+            double rate = bench_workload(server, ntasks, [&](int i) {
+                return server.add_task(std::bind(fun_sin<myType>, double(i % 100)));
+            });
+            best[enabled] = std::max(best[enabled], rate);
+            if (enabled && rep == 0)
+                server.print_stats(std::cout);
+            server.stop();
+        }
+    }
+    std::cout << "stats off " << best[0] << " ops/s, on " << best[1] << " ops/s, overhead "
+              << 100.0 * (best[0] - best[1]) / best[0] << "%\n";
+}
 
-    void server_loop(std::stop_token stoken) {
-        while (!stoken.stop_requested()) {
-            std::pair<size_t, std::packaged_task<T()>> task;
-            {
-                std::unique_lock<std::mutex> lock(queue_mutex);
-                cond_var.wait(lock, [this, &stoken] { return !tasks.empty() ||  stoken.stop_requested(); });
+// Клиенты бросают половину запросов. Без отмены сервер все равно их выполняет,
+// с отменой снимает из очереди, а выполняющиеся длинные задачи завершаются по stop_token
+void bench_cancel(size_t nworkers) {
+    const int ntasks = 4000;
+    const auto cost = std::chrono::microseconds(50);
+    auto slow_task = [cost](std::stop_token stoken) {
+        auto until = std::chrono::steady_clock::now() + cost;
+        while (std::chrono::steady_clock::now() < until) {
+            if (stoken.stop_requested()) return 0.0;
+        }
+        return 1.0;
+    };
+
+    for (bool use_cancel : {false, true}) {
+        Server<myType> server(nworkers);
+        server.start();
+        auto t1 = std::chrono::steady_clock::now();
+        std::vector<size_t> ids(ntasks);
+        for (int i = 0; i < ntasks; ++i)
+            ids[i] = server.add_cancellable_task(slow_task);
+
+        size_t timeouts = 0, cancelled = 0;
+        for (int i = 0; i < ntasks; ++i) {
+            if (i % 2 == 1) {
+                // Клиент потерял интерес к результату
+                if (use_cancel) server.cancel(ids[i]);
+                continue;
+            }
+            double value;
+            ResultStatus status = server.request_result(ids[i], std::chrono::seconds(5), value);
+            timeouts += status == ResultStatus::Timeout;
+            cancelled += status == ResultStatus::Cancelled;
+        }
+        // Без отмены брошенные задачи все равно доработают до конца
+        while (server.queue_depth() > 0)
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+        auto t2 = std::chrono::steady_clock::now();
+        std::chrono::duration<double> t = t2 - t1;
+
+        // Долгая задача, отмененная во время выполнения
+        size_t long_id = server.add_cancellable_task([](std::stop_token stoken) {
+            while (!stoken.stop_requested())
+                std::this_thread::sleep_for(std::chrono::microseconds(100));
+            return 0.0;
+        });
+        double value;
+        ResultStatus status = server.request_result(long_id, std::chrono::milliseconds(5), value);
+        server.cancel(long_id);
+
+        // Отмена уже завершенной задачи не должна отнимать ее результат
+        size_t done_id = server.add_cancellable_task([](std::stop_token) { return 2.0; });
+        while (server.queue_depth() > 0)
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        bool done_cancelled = server.cancel(done_id), done_kept = false;
+        if (!done_cancelled) {
+            try {
+                double done_value = 0.0;
+                done_kept = server.request_result(done_id, std::chrono::seconds(1), done_value) == ResultStatus::Ready
+                            && done_value == 2.0;
+            } catch (const std::runtime_error&) {
+                // id уже нет в results
+            }
+        }
+        server.stop();
+
+        CancelStats cs = server.cancel_stats();
+        std::cout << (use_cancel ? "with cancel: " : "without cancel: ") << t.count() << " s, timeouts "
+                  << timeouts << ", cancelled results " << cancelled << ", cancel requests " << cs.requested
+                  << ", skipped " << cs.skipped << ", cancelled while running " << cs.running
+                  << ", wasted " << cs.wasted_ns / 1e6 << " ms, long task "
+                  << (status == ResultStatus::Timeout ? "timed out and was stopped" : "finished") << ", cancel after finish "
+                  << (done_cancelled ? "was accepted (task was still running)"
+                      : done_kept ? "kept the result" : "LOST the result")
+                  << "\n";
+    }
+}
 
-                if (stoken.stop_requested()) break;
+// Цепочки pow(sin(x), y) глубины depth и слияния width листьев: граф задач против
+// клиента, который ждет каждый результат и отправляет следующую задачу сам
+void bench_dag(size_t nworkers) {
+    const int reps = 2000;
+    Server<myType> server(nworkers);
+    server.start();
 
-                if (!tasks.empty()) {
-                    task = std::move(tasks.front());
-                    tasks.pop();
-                }
+    auto time_it = [](auto&& body) {
+        auto t1 = std::chrono::steady_clock::now();
+        double checksum = 0.0;
+        for (int r = 0; r < reps; ++r)
+            checksum += body(r);
+        auto t2 = std::chrono::steady_clock::now();
+        if (is_nan(checksum))
+            std::cerr << "NaN in results\n";
+        return std::chrono::duration<double, std::micro>(t2 - t1).count() / reps;
+    };
+
+    for (int depth : {2, 8, 32}) {
+        double blocking = time_it([&](int r) {
+            double value = r % 100;
+            for (int d = 0; d < depth; ++d) {
+                size_t id = d % 2 == 0 ? server.add_task(std::bind(fun_sin<myType>, value))
+                                       : server.add_task(std::bind(fun_pow<myType>, value, 2.0));
+                value = server.request_result(id);
             }
-            try {
-                task.second();
-            } catch (const std::exception& e) {
-                std::cerr << "Task execution failed: " << e.what() << '\n';
-                continue;
+            return value;
+        });
+        double graph = time_it([&](int r) {
+            size_t id = server.add_task(std::bind(fun_sin<myType>, double(r % 100)));
+            for (int d = 1; d < depth; ++d) {
+                size_t next = d % 2 == 0 ? server.then(id, fun_sin<myType>)
+                                         : server.then(id, [](double v) { return fun_pow<myType>(v, 2.0); });
+                server.release(id);
+                id = next;
             }
+            return server.request_result(id);
+        });
+        std::cout << "chain depth " << depth << ": blocking " << blocking << " us, then() " << graph
+                  << " us, speedup " << blocking / graph << "\n";
+    }
 
+    for (int width : {4, 16, 64}) {
+        auto sum = [](const std::vector<double>& in) {
+            double total = 0.0;
+            for (double v : in) total += v;
+            return total;
+        };
+        double blocking = time_it([&](int r) {
+            std::vector<size_t> ids(width);
+            for (int k = 0; k < width; ++k)
+                ids[k] = server.add_task(std::bind(fun_sin<myType>, double((r + k) % 100)));
+            std::vector<double> values(width);
+            for (int k = 0; k < width; ++k)
+                values[k] = server.request_result(ids[k]);
+            return server.request_result(server.add_task([&] { return sum(values); }));
+        });
+        double graph = time_it([&](int r) {
+            std::vector<size_t> ids(width);
+            for (int k = 0; k < width; ++k)
+                ids[k] = server.add_task(std::bind(fun_sin<myType>, double((r + k) % 100)));
+            size_t total = server.add_task_after(ids, sum);
+            for (size_t id : ids)
+                server.release(id);
+            return server.request_result(total);
+        });
+        std::cout << "fan-in width " << width << ": blocking " << blocking << " us, graph " << graph
+                  << " us, speedup " << blocking / graph << "\n";
+    }
+    server.stop();
+}
 
+// Пропускная способность и справедливость между производителями: общая очередь под
+// мьютексом против отдельной очереди на производителя. У каждого производителя не больше
+// window невыполненных задач; справедливость - индекс Джайна по числу выполненных задач
+void bench_shards(size_t nworkers) {
+    const int window = 256;
+    const auto duration = std::chrono::milliseconds(300);
+    for (int nproducers : {1, 2, 4, 8, 16}) {
+        for (int sharded = 0; sharded < 2; ++sharded) {
+            Server<myType> server(nworkers);
+            server.enable_sharding(sharded);
+            server.enable_stats(false);
+            server.start();
+
+            std::vector<std::atomic<int>> done(nproducers);
+            std::atomic<bool> running{true};
+            std::vector<std::thread> producers;
+            auto begin = Clock::now();
+            for (int p = 0; p < nproducers; ++p) {
+                producers.emplace_back([&, p] {
+                    int sent = 0;
+                    while (running.load(std::memory_order_relaxed)) {
+                        if (sent - done[p].load(std::memory_order_acquire) >= window) {
+                            std::this_thread::yield();
+                            continue;
+                        }
+                        server.add_task(std::bind(fun_sin<myType>, double(sent % 100)),
+                                        [&done, p](myType, std::exception_ptr) {
+                                            done[p].fetch_add(1, std::memory_order_release);
+                                        });
+                        ++sent;
+                    }
+                });
+            }
+            std::this_thread::sleep_for(duration);
+            running = false;
+            std::chrono::duration<double> elapsed = Clock::now() - begin;
+            for (auto& producer : producers)
+                producer.join();
+            server.stop();
+
+            double total = 0.0, squares = 0.0;
+            for (auto& d : done) {
+                total += d.load();
+                squares += double(d.load()) * d.load();
+            }
+            double fairness = total > 0 ? total * total / (nproducers * squares) : 0.0;
+            std::cout << nproducers << " producers, " << (sharded ? "sharded" : "shared ")
+                      << ": " << total / elapsed.count() << " ops/s, fairness " << fairness << "\n";
         }
-        std::cout << "Server stopped.\n";
     }
-};
-
+}
 
-void add_task1_thread(Server<myType>& server) {
-    std::ofstream out;
-    out.open("Task1.txt");
-    for(int i = 0; i < 10000; ++i)
-    {    
-        double arg = std::experimental::randint(0, 100);
-        size_t task_id = server.add_task(std::bind(fun_sin<myType>, arg));
+double cpu_seconds() {
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec
+         + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
 
-        out << "sin " << arg << " = " << server.request_result(task_id) << '\n';
+// Задержка пробуждения (от отправки до начала выполнения) и загрузка CPU при разной
+// нагрузке. Нагрузка - доля от пропускной способности воркеров при стоимости задачи cost.
+// CPU - процессорное время всего процесса (вместе с отправителем) в долях одного ядра
+void bench_idle(size_t nworkers) {
+    const auto cost = std::chrono::microseconds(50);
+    const auto duration = std::chrono::milliseconds(500);
+    size_t cores = std::min<size_t>(nworkers, std::max(1u, std::thread::hardware_concurrency()));
+    double capacity = cores * 1e6 / cost.count();
+
+    struct Config {
+        const char* name;
+        IdlePolicy idle;
+        bool autoscale;
+    };
+    const Config configs[] = {
+        {"park", {0, 0}, false},
+        {"spin+yield+park", {}, false},
+        {"spin+yield+park, autoscale", {}, true},
+    };
+    for (double load : {0.01, 0.5, 1.0}) {
+        for (const Config& config : configs) {
+            Server<myType> server(nworkers);
+            server.set_idle_policy(config.idle);
+            if (config.autoscale)
+                server.enable_autoscale(1, std::chrono::milliseconds(5));
+            server.start();
+
+            LatencyHistogram wakeup;
+            std::atomic<size_t> done{0};
+            size_t sent = 0;
+            auto gap = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / (load * capacity)));
+            double cpu0 = cpu_seconds();
+            auto begin = Clock::now();
+            auto end = begin + duration;
+            for (auto intended = begin; intended < end; intended += gap, ++sent) {
+                std::this_thread::sleep_until(intended);
+                auto submitted = Clock::now();
+                server.add_task([&, submitted] {
+                    auto start = Clock::now();
+                    wakeup.record(std::chrono::duration_cast<std::chrono::nanoseconds>(start - submitted).count());
+                    while (Clock::now() - start < cost) {
+                    }
+                    done.fetch_add(1, std::memory_order_relaxed);
+                    return myType{};
+                });
+            }
+            while (done.load() < sent)
+                std::this_thread::sleep_for(std::chrono::microseconds(100));
+            std::chrono::duration<double> elapsed = Clock::now() - begin;
+            double cpu = (cpu_seconds() - cpu0) / elapsed.count();
+            size_t active = server.active_worker_count();
+            server.stop();
+
+            std::cout << 100 * load << "% load, " << config.name << ": wakeup p50="
+                      << wakeup.percentile(0.5) / 1000.0 << "us p99=" << wakeup.percentile(0.99) / 1000.0
+                      << "us, cpu " << 100 * cpu << "%";
+            if (config.autoscale)
+                std::cout << ", workers " << active << "/" << nworkers << " (+" << server.scale_ups()
+                          << " -" << server.scale_downs() << ")";
+            std::cout << "\n";
+        }
     }
-    out.close();
 }
 
-void add_task2_thread(Server<myType>& server) {
-    std::ofstream out;
-    out.open("Task2.txt");
-    for(int i = 0; i < 10000; ++i)
-    {    
-        double arg = std::experimental::randint(0, 100);
-        size_t task_id = server.add_task(std::bind(fun_sqrt<myType>, arg));
+// Запись результатов Task1-3 без сервера: ofstream против ResultFile. Три потока,
+// у каждого свой файл, как в основном режиме. Содержимое файлов должно совпасть байт в байт
+void bench_writer(int nlines) {
+    const char* names[] = {"sin", "sqrt", "pow"};
+    auto write_lines = [&](int k, auto& out) {
+        for (int i = 0; i < nlines; ++i) {
+            double arg1 = i % 101;
+            double arg2 = i % 21;
+            if (k == 0) out << "sin " << arg1 << " = " << fun_sin<myType>(arg1) << '\n';
+            else if (k == 1) out << "sqrt " << arg1 << " = " << fun_sqrt<myType>(arg1) << '\n';
+            else out << "pow " << arg1 << " " << arg2 << " = " << fun_pow<myType>(arg1, arg2) << '\n';
+        }
+    };
+    auto path = [&](const char* kind, int k) { return std::string("bench_") + kind + "_" + names[k] + ".txt"; };
+
+    double seconds[2];
+    for (int async = 0; async < 2; ++async) {
+        auto t1 = std::chrono::steady_clock::now();
+        std::vector<std::thread> threads;
+        for (int k = 0; k < 3; ++k) {
+            threads.emplace_back([&, k] {
+                if (async) {
+                    ResultFile file(path("async", k));
+                    auto out = file.writer();
+                    write_lines(k, out);
+                } else {
+                    std::ofstream out(path("ofstream", k));
+                    write_lines(k, out);
+                }
+            });
+        }
+        for (auto& t : threads)
+            t.join();
+        seconds[async] = std::chrono::duration<double>(std::chrono::steady_clock::now() - t1).count();
+    }
 
-        out << "sqrt " << arg << " = " << server.request_result(task_id) << '\n';
+    size_t bytes = 0;
+    bool identical = true;
+    for (int k = 0; k < 3; ++k) {
+        std::ifstream a(path("ofstream", k), std::ios::binary), b(path("async", k), std::ios::binary);
+        std::string sa((std::istreambuf_iterator<char>(a)), {}), sb((std::istreambuf_iterator<char>(b)), {});
+        bytes += sa.size();
+        identical = identical && sa == sb;
+        std::remove(path("ofstream", k).c_str());
+        std::remove(path("async", k).c_str());
     }
-    out.close();
+    std::cout << 3 * nlines << " lines, " << bytes / 1e6 << " MB: ofstream " << seconds[0] << " s ("
+              << bytes / 1e6 / seconds[0] << " MB/s), ResultFile " << seconds[1] << " s ("
+              << bytes / 1e6 / seconds[1] << " MB/s), speedup " << seconds[0] / seconds[1]
+              << ", output " << (identical ? "identical" : "DIFFERS") << "\n";
 }
 
-void add_task3_thread(Server<myType>& server) {
-    std::ofstream out;
-    out.open("Task3.txt");
-    for(int i = 0; i < 10000; ++i)
-    {    
-        double arg1 = std::experimental::randint(0, 100);
-        double arg2 = std::experimental::randint(0, 20);
-        size_t task_id = server.add_task(std::bind(fun_pow<myType>, arg1, arg2));
+// Проверка на лету: результаты типизированных запросов идут из воркеров по VerifyChannel
+// в поток проверки, пока клиенты продолжают отправлять запросы. fault_at > 0 портит
+// результат с этим номером, чтобы показать, как быстро прогон останавливается
+void bench_verify(int ntasks, long fault_at) {
+    static_assert(static_cast<int>(Op::Sin) == static_cast<int>(ResultOp::Sin)
+                  && static_cast<int>(Op::Sqrt) == static_cast<int>(ResultOp::Sqrt)
+                  && static_cast<int>(Op::Pow) == static_cast<int>(ResultOp::Pow));
+    VerifyChannel channel;
+    std::atomic<long> produced{0};
+    std::atomic<bool> failed{false};
+    Clock::time_point fault_time;
+
+    Server<myType> server;
+    server.set_result_tap([&](Op op, const myType* x, const myType* y, const myType* res, size_t n) {
+        ResultRow rows[Server<myType>::BATCH_SIZE];
+        long first = produced.fetch_add(n);
+        for (size_t i = 0; i < n; ++i) {
+            rows[i] = {static_cast<ResultOp>(op), x[i], y[i], res[i]};
+            if (first + long(i) + 1 == fault_at) {
+                rows[i].result += 1e-3;
+                fault_time = Clock::now();
+            }
+        }
+        channel.push(rows, n);
+    });
+    server.start();
+
+    // Векторные sin/pow из libmvec отличаются от libm на несколько ULP
+    StreamVerifier verifier(make_policy("simd"));
+    std::thread checker([&] {
+        std::vector<ResultRow> rows;
+        while (channel.pop(rows, 1024)) {
+            for (const ResultRow& row : rows) {
+                if (!verifier.check(row)) {
+                    failed = true;
+                    channel.close();
+                    return;
+                }
+            }
+            rows.clear();
+        }
+    });
+
+    auto t1 = Clock::now();
+    std::vector<std::thread> clients;
+    for (int k = 0; k < 3; ++k) {
+        clients.emplace_back([&, k] {
+            std::vector<size_t> ids;
+            for (int i = 0; i < ntasks && !failed; ++i) {
+                double arg1 = std::experimental::randint(0, 100);
+                double arg2 = std::experimental::randint(0, 20);
+                ids.push_back(server.add_op(static_cast<Op>(k), arg1, arg2));
+                if (ids.size() == Server<myType>::BATCH_SIZE) {
+                    for (size_t id : ids) server.request_result(id);
+                    ids.clear();
+                }
+            }
+            for (size_t id : ids) server.request_result(id);
+        });
+    }
+    for (auto& client : clients)
+        client.join();
+    channel.close();
+    checker.join();
+    double seconds = std::chrono::duration<double>(Clock::now() - t1).count();
+    server.stop();
 
-        out << "pow " << arg1 << " " <<  arg2 << " = " << server.request_result(task_id) << '\n';
+    if (verifier.failed()) {
+        std::cout << "failure after " << produced.load() << " results, detected "
+                  << std::chrono::duration<double, std::micro>(verifier.failure_time() - fault_time).count()
+                  << " us after it was produced: " << verifier.failure() << "\n";
+    } else {
+        std::cout << verifier.lines() << " results verified on the fly in " << seconds << " s\n";
     }
-    out.close();
+    verifier.stats().report(std::cout);
 }
 
-int main() {
+int main(int argc, char** argv) {
+    if (argc > 1 && std::string(argv[1]) == "bench") {
+        bench_ops(argc > 2 ? std::atoi(argv[2]) : 1);
+        return 0;
+    }
+    if (argc > 1 && std::string(argv[1]) == "prio") {
+        bench_priority(argc > 2 ? std::atoi(argv[2]) : 1);
+        return 0;
+    }
+    if (argc > 1 && std::string(argv[1]) == "overload") {
+        bench_overload(argc > 2 ? std::atoi(argv[2]) : 1);
+        return 0;
+    }
+    if (argc > 1 && std::string(argv[1]) == "stats") {
+        bench_stats(argc > 2 ? std::atoi(argv[2]) : 1);
+        return 0;
+    }
+    if (argc > 1 && std::string(argv[1]) == "cancel") {
+        bench_cancel(argc > 2 ? std::atoi(argv[2]) : 1);
+        return 0;
+    }
+    if (argc > 1 && std::string(argv[1]) == "dag") {
+        bench_dag(argc > 2 ? std::atoi(argv[2]) : 1);
+        return 0;
+    }
+    if (argc > 1 && std::string(argv[1]) == "shards") {
+        bench_shards(argc > 2 ? std::atoi(argv[2]) : 1);
+        return 0;
+    }
+    if (argc > 1 && std::string(argv[1]) == "idle") {
+        bench_idle(argc > 2 ? std::atoi(argv[2]) : 4);
+        return 0;
+    }
+    if (argc > 1 && std::string(argv[1]) == "writer") {
+        bench_writer(argc > 2 ? std::atoi(argv[2]) : 1000000);
+        return 0;
+    }
+    if (argc > 1 && std::string(argv[1]) == "verify") {
+        bench_verify(argc > 2 ? std::atoi(argv[2]) : 100000, argc > 3 ? std::atol(argv[3]) : 0);
+        return 0;
+    }
+    if (argc > 1 && std::string(argv[1]) == "coro") {
+        bench_coro(argc > 2 ? std::atoi(argv[2]) : 10000, argc > 3 ? std::atoi(argv[3]) : 4);
+        return 0;
+    }
+
     std::cout << "Start\n";
 
     Server<myType> server;
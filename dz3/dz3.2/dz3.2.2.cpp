@@ -1,103 +1,472 @@
 #include <iostream>
-#include <fstream>
-#include <sstream>
 #include <string>
 #include <cmath>
 #include <vector>
 #include <stdexcept>
+#include <charconv>
+#include <filesystem>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <optional>
 
-#define LOG_EN false
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <omp.h>
 
-struct Result {
-    std::string operation;
-    double arg1;
-    double arg2;
-    double result;
-};
+#include "result_format.h"
+#include "ulp_verify.h"
+#include "result_text.h"
+#include "stream_verify.h"
 
-Result parse_result(const std::string& line) {
-    Result res;
-    std::istringstream fun(line);
-    std::string op;
-    char c;
-
-    fun >> op;
-
-    if (op == "sin" || op == "sqrt") {
-        fun >> res.arg1 >> c >> res.result;
-        res.operation = op;
-    } 
-    else if (op == "pow") {
-        fun >> res.arg1 >> res.arg2 >> c >> res.result;
-        res.operation = op;
-    } 
-    else {
-        throw std::runtime_error("Unknown operation: " + op);
-    }
-    return res;
-}
+// Проверка файлов результатов. Текстовые файлы отображаются в память и режутся на куски
+// по границам строк, куски разбираются параллельно через std::from_chars, ожидаемые
+// значения считаются пакетами по операциям в omp simd циклах.
+//
+// g++ -std=c++20 -O3 -fopenmp -fno-math-errno dz3.2.2.cpp -o test
+//   (без -ffast-math: -ffinite-math-only выбросил бы проверки NaN и бесконечностей)
+// ./test [-t] [--stats] [--policy bits|exact|libm|simd|float|text] [--ulps sin=4,pow=8] [files...]
+//   по умолчанию Task1-3.txt и Task1-3.bin; -t печатает скорость, --stats - гистограммы ошибок в ULP.
+//   Политика по умолчанию: text для текстовых файлов (6 знаков), bits для двоичных
+// ./test --stream <fifo|->            проверка по мере чтения из канала или stdin
+// ./test --follow <file> [--idle-ms N] проверка дописываемого файла (inotify) до N мс без новых
+//                                       данных; закрытие файла писателем концом не считается
+//   В потоковых режимах проверка останавливается на первой ошибке, код возврата 1
 
-bool check_result(const Result& res) {
-    double expected_result = 0.0;
+#define LOG_EN false
 
-    if (res.operation == "sin") {
-        expected_result = std::sin(res.arg1);
-    } 
-    else if (res.operation == "sqrt") {
-        expected_result = std::sqrt(res.arg1);
-    } 
-    else if (res.operation == "pow") {
-        expected_result = std::pow(res.arg1, res.arg2);
-    }
+bool check_result(const ResultRow& res, double epsilon) {
+    double expected_result = libm_value(res.operation, res.arg1, res.arg2);
 
     if(LOG_EN){
         std::cout << "Expected: " << expected_result << std::endl;
         std::cout << "Result: " << res.result << std::endl;
         std::cout << "Dif: " << std::fabs(expected_result - res.result) << std::endl;
     }
+    return within_mixed(expected_result, res.result, epsilon);
+}
+
+class MappedFile {
+public:
+    explicit MappedFile(const std::string& path) {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            throw std::runtime_error("Cannot open file: " + path);
+        struct stat st;
+        if (fstat(fd, &st) != 0) {
+            ::close(fd);
+            throw std::runtime_error("Cannot stat file: " + path);
+        }
+        length = static_cast<size_t>(st.st_size);
+        if (length > 0) {
+            void* p = mmap(nullptr, length, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+            if (p == MAP_FAILED) {
+                ::close(fd);
+                throw std::runtime_error("Cannot map file: " + path);
+            }
+            bytes = static_cast<const char*>(p);
+        }
+        ::close(fd);
+    }
 
-    const double epsilon = 1e-5;
-    double max_value = std::max(std::fabs(expected_result), std::fabs(res.result));
-    if (max_value == 0) {
-        return true;
+    ~MappedFile() {
+        if (bytes) munmap(const_cast<char*>(bytes), length);
     }
-    double error;
-    if(max_value >= 1)
-        error = std::fabs(expected_result - res.result)/max_value;
-    else
-        error = std::fabs(expected_result - res.result);
 
-    return error <= epsilon;
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const char* data() const { return bytes; }
+    size_t size() const { return length; }
+
+private:
+    const char* bytes = nullptr;
+    size_t length = 0;
+};
+
+// Кусок файла из целых строк
+struct Chunk {
+    size_t file;
+    const char* begin;
+    const char* end;
+};
+
+struct VerifyOptions {
+    std::optional<TolerancePolicy> policy;  // если не задана, по типу файла
+    bool stats = false;
+    bool timing = false;
+};
+
+struct ChunkReport {
+    std::unique_ptr<UlpVerifier> engine;  // нет - быстрая пакетная проверка по mixed_eps
+    double mixed_eps = 0.0;
+    size_t lines = 0;
+    size_t failed = 0;
+    std::vector<const char*> failures;  // начала непрошедших строк, не больше MAX_REPORTED
+    std::string error;
+};
+
+constexpr size_t VERIFY_BATCH = 256;
+constexpr size_t MAX_REPORTED = 10;
+constexpr size_t MIN_CHUNK_BYTES = 1 << 20;
+
+// Строки одной операции, ожидающие пересчета
+struct OpBatch {
+    double arg1[VERIFY_BATCH];
+    double arg2[VERIFY_BATCH];
+    double result[VERIFY_BATCH];
+    const char* line[VERIFY_BATCH];
+    size_t size = 0;
+};
+
+template <ResultOp OP>
+void check_batch(OpBatch& batch, ChunkReport& report) {
+    if (report.engine) {
+        for (size_t i = 0; i < batch.size; ++i) {
+            if (report.engine->add(OP, batch.arg1[i], batch.arg2[i], batch.result[i])) continue;
+            ++report.failed;
+            if (report.failures.size() < MAX_REPORTED)
+                report.failures.push_back(batch.line[i]);
+        }
+        batch.size = 0;
+        return;
+    }
+    const double eps = report.mixed_eps;
+    bool ok[VERIFY_BATCH];
+    size_t failed = 0;
+    #pragma omp simd reduction(+:failed)
+    for (size_t i = 0; i < batch.size; ++i) {
+        double expected;
+        if constexpr (OP == ResultOp::Sin) expected = std::sin(batch.arg1[i]);
+        else if constexpr (OP == ResultOp::Sqrt) expected = std::sqrt(batch.arg1[i]);
+        else expected = std::pow(batch.arg1[i], batch.arg2[i]);
+        ok[i] = within_mixed(expected, batch.result[i], eps);
+        failed += !ok[i];
+    }
+    if (failed > 0) {
+        // Пакетная проверка могла ошибиться только в последних битах, перепроверяем скалярно
+        for (size_t i = 0; i < batch.size; ++i) {
+            if (ok[i] || check_result({OP, batch.arg1[i], batch.arg2[i], batch.result[i]}, eps)) continue;
+            ++report.failed;
+            if (report.failures.size() < MAX_REPORTED)
+                report.failures.push_back(batch.line[i]);
+        }
+    }
+    batch.size = 0;
 }
 
+void verify_chunk(const Chunk& chunk, ChunkReport& report) {
+    OpBatch batches[static_cast<size_t>(ResultOp::Count)];
+    auto flush = [&](ResultOp op) {
+        OpBatch& batch = batches[static_cast<size_t>(op)];
+        switch (op) {
+            case ResultOp::Sin: check_batch<ResultOp::Sin>(batch, report); break;
+            case ResultOp::Sqrt: check_batch<ResultOp::Sqrt>(batch, report); break;
+            default: check_batch<ResultOp::Pow>(batch, report); break;
+        }
+    };
 
-void test_results(const std::string& filename) {
-    std::ifstream file(filename);
-    std::string line;
-    int line_number = 0;
-    bool all_passed = true;
+    const char* end = chunk.end;
+    for (const char* p = chunk.begin; p < end;) {
+        const char* line = p;
+        ResultRow row;
+        p = parse_result_line(p, end, row);
+        ++report.lines;
 
-    while (std::getline(file, line)) {
-        ++line_number;
-        Result res = parse_result(line);
-        if (!check_result(res)) {
-            std::cerr << "Test failed at line " << line_number << ": " << line << '\n';
-            all_passed = false;
+        OpBatch& batch = batches[static_cast<size_t>(row.operation)];
+        batch.arg1[batch.size] = row.arg1;
+        batch.arg2[batch.size] = row.arg2;
+        batch.result[batch.size] = row.result;
+        batch.line[batch.size] = line;
+        if (++batch.size == VERIFY_BATCH)
+            flush(row.operation);
+    }
+    for (size_t k = 0; k < static_cast<size_t>(ResultOp::Count); ++k)
+        flush(static_cast<ResultOp>(k));
+}
+
+// Режет файл на куски примерно поровну между потоками, сдвигая границы к концу строки
+void split_lines(size_t file, const MappedFile& mapped, size_t nchunks, std::vector<Chunk>& chunks) {
+    const char* begin = mapped.data();
+    const char* end = begin + mapped.size();
+    nchunks = std::max<size_t>(1, std::min(nchunks, mapped.size() / MIN_CHUNK_BYTES));
+    size_t step = mapped.size() / nchunks;
+    while (begin < end) {
+        const char* cut = end - begin > static_cast<ptrdiff_t>(step) ? begin + step : end;
+        if (cut < end) {
+            const char* newline = static_cast<const char*>(std::memchr(cut, '\n', end - cut));
+            cut = newline ? newline + 1 : end;
         }
-        if(LOG_EN)
-            std::cout << "======\n";
+        chunks.push_back({file, begin, cut});
+        begin = cut;
     }
+}
 
-    if (all_passed) {
-        std::cout << line_number << " tests passed from file " << filename << ".\n";
+// Файл, который не удалось открыть, пропускается с сообщением, остальные проверяются.
+// Возвращает false, если были такие файлы
+bool test_results(const std::vector<std::string>& filenames, const VerifyOptions& options) {
+    TolerancePolicy policy = options.policy.value_or(make_policy("text"));
+    auto t1 = std::chrono::steady_clock::now();
+    std::vector<std::unique_ptr<MappedFile>> files(filenames.size());
+    std::vector<Chunk> chunks;
+    size_t total_bytes = 0;
+    bool all_read = true;
+    for (size_t f = 0; f < filenames.size(); ++f) {
+        try {
+            files[f] = std::make_unique<MappedFile>(filenames[f]);
+        } catch (const std::exception& e) {
+            std::cerr << e.what() << '\n';
+            all_read = false;
+            continue;
+        }
+        madvise(const_cast<char*>(files[f]->data()), files[f]->size(), MADV_SEQUENTIAL);
+        split_lines(f, *files[f], omp_get_max_threads(), chunks);
+        total_bytes += files[f]->size();
+    }
+
+    // Пакетная проверка в double годится только для допуска по mixed_eps без статистики,
+    // иначе каждая строка сверяется с эталоном в long double
+    std::vector<ChunkReport> reports(chunks.size());
+    for (auto& report : reports) {
+        if (options.stats || policy.mixed_eps == 0)
+            report.engine = std::make_unique<UlpVerifier>(policy);
+        report.mixed_eps = policy.mixed_eps;
+    }
+    #pragma omp parallel for schedule(dynamic, 1)
+    for (size_t c = 0; c < chunks.size(); ++c) {
+        try {
+            verify_chunk(chunks[c], reports[c]);
+        } catch (const std::exception& e) {
+            reports[c].error = e.what();
+        }
+    }
+
+    // Куски одного файла идут подряд и по порядку
+    for (size_t f = 0, c = 0; f < filenames.size(); ++f) {
+        if (!files[f]) continue;
+        size_t lines = 0, failed = 0;
+        std::string error;
+        const char* data = files[f]->data();
+        UlpVerifier total(policy);
+        for (; c < chunks.size() && chunks[c].file == f; ++c) {
+            const ChunkReport& report = reports[c];
+            if (report.engine)
+                total.merge(*report.engine);
+            for (const char* line : report.failures) {
+                size_t line_number = std::count(data, line, '\n') + 1;
+                std::cerr << "Test failed at line " << line_number << ": "
+                          << std::string(line, std::find(line, data + files[f]->size(), '\n')) << '\n';
+            }
+            if (error.empty() && !report.error.empty())
+                error = report.error;
+            lines += report.lines;
+            failed += report.failed;
+        }
+        if (!error.empty()) {
+            std::cerr << filenames[f] << ": " << error << '\n';
+        } else if (failed == 0) {
+            std::cout << lines << " tests passed from file " << filenames[f] << ".\n";
+        } else {
+            std::cerr << "Fail.\n";
+        }
+        if (options.stats)
+            total.report(std::cout);
+    }
+
+    if (options.timing) {
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t1).count();
+        std::cout << total_bytes / 1e6 << " MB in " << seconds << " s, " << total_bytes / 1e9 / seconds
+                  << " GB/s on " << omp_get_max_threads() << " threads\n";
+    }
+    return all_read;
+}
+
+// Двоичный файл хранит значения точно, поэтому ошибка меряется в ULP относительно эталона
+void test_results_binary(const std::string& filename, const VerifyOptions& options) {
+    ResultReader reader(filename);
+    TolerancePolicy policy = options.policy.value_or(make_policy("bits"));
+    UlpVerifier engine(policy);
+    size_t row = 0, failed = 0;
+    reader.for_each([&](ResultOp op, double arg1, double arg2, double result) {
+        ++row;
+        if (engine.add(op, arg1, arg2, result)) return;
+        if (++failed <= MAX_REPORTED)
+            std::cerr << "Test failed at row " << row << ": " << result_op_name(op) << " " << arg1
+                      << " " << arg2 << " = " << result << ", " << ulp_error(result, reference_value(op, arg1, arg2))
+                      << " ulp\n";
+    });
+
+    if (failed == 0) {
+        std::cout << row << " tests passed from file " << filename << " (" << policy.name << ").\n";
     } else {
-        std::cerr << "Fail.\n";
+        std::cerr << "Fail: " << failed << " of " << row << " rows out of tolerance.\n";
+    }
+    if (options.stats)
+        engine.report(std::cout);
+}
+
+void report_stream(const std::string& name, const StreamVerifier& verifier,
+                   std::chrono::steady_clock::time_point started, const VerifyOptions& options) {
+    if (verifier.failed()) {
+        double ms = std::chrono::duration<double, std::milli>(verifier.failure_time() - started).count();
+        std::cerr << name << ": first failure at line " << verifier.failure_line() << " (" << ms
+                  << " ms after start): " << verifier.failure() << '\n';
+    } else {
+        std::cout << verifier.lines() << " tests passed from stream " << name << ".\n";
+    }
+    if (options.stats)
+        verifier.stats().report(std::cout);
+}
+
+// Дочитывает fd до конца имеющихся данных. false - найдена ошибка
+bool drain_fd(int fd, StreamVerifier& verifier, std::vector<char>& buffer, bool& eof) {
+    while (true) {
+        ssize_t n = ::read(fd, buffer.data(), buffer.size());
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) throw std::runtime_error(std::string("read failed: ") + std::strerror(errno));
+        if (n == 0) {
+            eof = true;
+            return true;
+        }
+        if (!verifier.feed(buffer.data(), static_cast<size_t>(n)))
+            return false;
+    }
+}
+
+bool stream_results(const std::string& path, const VerifyOptions& options) {
+    auto started = std::chrono::steady_clock::now();
+    int fd = path == "-" ? STDIN_FILENO : ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        throw std::runtime_error("Cannot open " + path);
+    StreamVerifier verifier(options.policy.value_or(make_policy("text")));
+    std::vector<char> buffer(1 << 16);
+    bool eof = false;
+    if (drain_fd(fd, verifier, buffer, eof))
+        verifier.finish();
+    if (fd != STDIN_FILENO) ::close(fd);
+    report_stream(path, verifier, started, options);
+    return !verifier.failed();
+}
+
+bool follow_results(const std::string& path, const VerifyOptions& options, int idle_ms) {
+    auto started = std::chrono::steady_clock::now();
+    auto idle = std::chrono::milliseconds(idle_ms);
+
+    // Файл может еще не существовать
+    int fd;
+    while ((fd = ::open(path.c_str(), O_RDONLY)) < 0) {
+        if (std::chrono::steady_clock::now() - started > idle)
+            throw std::runtime_error("Cannot open " + path);
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    int inotify = inotify_init1(IN_CLOEXEC);
+    if (inotify < 0 || inotify_add_watch(inotify, path.c_str(), IN_MODIFY) < 0) {
+        ::close(fd);
+        throw std::runtime_error("inotify failed for " + path);
     }
+
+    StreamVerifier verifier(options.policy.value_or(make_policy("text")));
+    std::vector<char> buffer(1 << 16);
+    alignas(inotify_event) char events[4096];
+    // Закрытие файла писателем - не конец: его могут открыть снова и дописать. Конец -
+    // idle_ms без новых данных, считая от последнего прочитанного байта, а не от события
+    off_t position = 0;
+    auto last_data = std::chrono::steady_clock::now();
+    while (true) {
+        bool eof = false;
+        if (!drain_fd(fd, verifier, buffer, eof))
+            break;
+        auto now = std::chrono::steady_clock::now();
+        off_t new_position = ::lseek(fd, 0, SEEK_CUR);
+        if (new_position != position) {
+            position = new_position;
+            last_data = now;
+        }
+        auto left = std::chrono::ceil<std::chrono::milliseconds>(idle - (now - last_data));
+        if (left.count() <= 0) {
+            std::cerr << path << ": no new data for " << idle_ms << " ms, stopping\n";
+            break;
+        }
+        pollfd pfd{inotify, POLLIN, 0};
+        int ready = poll(&pfd, 1, static_cast<int>(left.count()));
+        if (ready < 0 && errno != EINTR)
+            throw std::runtime_error(std::string("poll failed: ") + std::strerror(errno));
+        if (ready > 0)
+            (void)::read(inotify, events, sizeof(events));
+    }
+    if (!verifier.failed())
+        verifier.finish();
+    ::close(inotify);
+    ::close(fd);
+    report_stream(path, verifier, started, options);
+    return !verifier.failed();
 }
 
-int main() {
-    test_results("Task1.txt");
-    test_results("Task2.txt");
-    test_results("Task3.txt");
-    return 0;
+int main(int argc, char** argv) {
+    VerifyOptions options;
+    std::vector<std::string> text_files, binary_files;
+    std::string ulp_limits, stream_path, follow_path;
+    int idle_ms = 10000;
+    try {
+        for (int i = 1; i < argc; ++i) {
+            std::string arg = argv[i];
+            auto value = [&]() -> std::string {
+                if (i + 1 >= argc)
+                    throw std::runtime_error("Missing value for " + arg);
+                return argv[++i];
+            };
+            if (arg == "-t") options.timing = true;
+            else if (arg == "--stats") options.stats = true;
+            else if (arg == "--policy") options.policy = make_policy(value());
+            else if (arg == "--ulps") ulp_limits = value();
+            else if (arg == "--stream") stream_path = value();
+            else if (arg == "--follow") follow_path = value();
+            else if (arg == "--idle-ms") idle_ms = std::atoi(value().c_str());
+            else if (arg.ends_with(".bin")) binary_files.push_back(arg);
+            else text_files.push_back(arg);
+        }
+        if (!ulp_limits.empty()) {
+            if (!options.policy) options.policy = make_policy("libm");
+            set_ulp_limits(*options.policy, ulp_limits);
+        }
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << '\n';
+        return 1;
+    }
+    if (!stream_path.empty() || !follow_path.empty()) {
+        try {
+            bool ok = !stream_path.empty() ? stream_results(stream_path, options)
+                                           : follow_results(follow_path, options, idle_ms);
+            return ok ? 0 : 1;
+        } catch (const std::exception& e) {
+            std::cerr << e.what() << '\n';
+            return 1;
+        }
+    }
+    if (text_files.empty() && binary_files.empty()) {
+        text_files = {"Task1.txt", "Task2.txt", "Task3.txt"};
+        for (const char* filename : {"Task1.bin", "Task2.bin", "Task3.bin"}) {
+            if (std::filesystem::exists(filename))
+                binary_files.push_back(filename);
+        }
+    }
+
+    // Ошибка чтения одного файла не мешает проверить остальные
+    bool all_read = true;
+    if (!text_files.empty())
+        all_read = test_results(text_files, options);
+    for (const auto& filename : binary_files) {
+        try {
+            test_results_binary(filename, options);
+        } catch (const std::exception& e) {
+            std::cerr << e.what() << '\n';
+            all_read = false;
+        }
+    }
+    return all_read ? 0 : 1;
 }
\ No newline at end of file
@@ -0,0 +1,134 @@
+#include <iostream>
+#include <string>
+#include <chrono>
+#include <thread>
+#include <csignal>
+#include <cstdlib>
+#include <future>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "ipc.h"
+
+// g++ -std=c++20 -O3 -fopenmp ipc.cpp -o ipc
+// ./ipc server /tmp/paralelki.sock [workers]   - сервер до Ctrl+C
+// ./ipc call /tmp/paralelki.sock pow 2 10      - один запрос через общую память
+// ./ipc bench [requests]                       - задержка запрос/ответ: в процессе, shm, сокет
+
+std::atomic<bool> interrupted{false};
+
+void run_server(const std::string& path, size_t nworkers) {
+    Server<double> server(nworkers);
+    server.start();
+    IpcServer ipc(server, path);
+    std::signal(SIGINT, [](int) { interrupted = true; });
+    std::signal(SIGTERM, [](int) { interrupted = true; });
+    std::jthread acceptor([&ipc](std::stop_token stoken) { ipc.run(stoken); });
+    while (!interrupted)
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    acceptor.request_stop();
+}
+
+template<typename Call>
+void measure(const char* name, int requests, Call call) {
+    LatencyHistogram hist;
+    double checksum = 0.0;
+    for (int i = 0; i < requests; ++i) {
+        auto t1 = std::chrono::steady_clock::now();
+        checksum += call(i);
+        auto t2 = std::chrono::steady_clock::now();
+        hist.record(std::chrono::duration_cast<std::chrono::nanoseconds>(t2 - t1).count());
+    }
+    if (std::isnan(checksum))
+        std::cerr << "NaN in results\n";
+    std::cout << name << ": p50=" << hist.percentile(0.5) / 1000.0 << "us p99="
+              << hist.percentile(0.99) / 1000.0 << "us p999=" << hist.percentile(0.999) / 1000.0 << "us\n";
+}
+
+Op parse_op(const std::string& name) {
+    if (name == "sin") return Op::Sin;
+    if (name == "sqrt") return Op::Sqrt;
+    if (name == "pow") return Op::Pow;
+    throw std::runtime_error("Unknown op: " + name + " (sin, sqrt, pow)");
+}
+
+void bench(int requests) {
+    std::string path = "/tmp/paralelki-ipc-" + std::to_string(getpid()) + ".sock";
+    pid_t child = fork();
+    if (child == 0) {
+        run_server(path, 1);
+        _exit(0);
+    }
+
+    // Тот же путь, что у IPC-сервера: задача из ipc_task и ответ через callback
+    {
+        Server<double> server;
+        server.start();
+        measure("in-process", requests, [&](int i) {
+            std::promise<double> done;
+            std::future<double> result = done.get_future();
+            server.add_task(ipc_task({0, static_cast<uint32_t>(Op::Sin), 0, double(i % 100), 0.0}),
+                            [&done](double value, std::exception_ptr err) {
+                                if (err) done.set_exception(err); else done.set_value(value);
+                            });
+            return result.get();
+        });
+    }
+
+    std::unique_ptr<IpcClient> client;
+    for (int attempt = 0; attempt < 100 && !client; ++attempt) {
+        try {
+            client = std::make_unique<IpcClient>(path);
+        } catch (const std::runtime_error&) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        }
+    }
+    if (!client) {
+        std::cerr << "Cannot connect to IPC server\n";
+    } else {
+        measure("shared memory", requests, [&](int i) { return client->call(Op::Sin, i % 100); });
+        measure("unix socket", requests, [&](int i) { return client->call_socket(Op::Sin, i % 100); });
+
+        // Пропускная способность с окном запросов в полете
+        auto t1 = std::chrono::steady_clock::now();
+        const int window = 256;
+        IpcResponse resp;
+        for (int i = 0; i < requests; ++i) {
+            if (i >= window)
+                resp = client->wait_response();
+            client->submit(Op::Sin, i % 100);
+        }
+        for (int i = 0; i < std::min(window, requests); ++i)
+            resp = client->wait_response();
+        auto t2 = std::chrono::steady_clock::now();
+        std::cout << "shared memory pipelined: "
+                  << requests / std::chrono::duration<double>(t2 - t1).count() << " req/s\n";
+        client.reset();
+    }
+
+    kill(child, SIGTERM);
+    waitpid(child, nullptr, 0);
+}
+
+int main(int argc, char** argv) {
+    std::string mode = argc > 1 ? argv[1] : "bench";
+    try {
+        if (mode == "server" && argc > 2) {
+            run_server(argv[2], argc > 3 ? std::atoi(argv[3]) : 1);
+        } else if (mode == "call" && argc > 4) {
+            Op code = parse_op(argv[3]);
+            IpcClient client(argv[2]);
+            std::cout << client.call(code, std::atof(argv[4]), argc > 5 ? std::atof(argv[5]) : 0.0) << '\n';
+        } else if (mode == "bench") {
+            bench(argc > 2 ? std::atoi(argv[2]) : 20000);
+        } else {
+            std::cerr << "Usage: ipc server PATH [workers] | call PATH OP X [Y] | bench [requests]\n";
+            return 1;
+        }
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << '\n';
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,491 @@
+#pragma once
+
+// Доступ к Server<double> из других процессов на той же машине (только Linux).
+//
+// Unix-сокет служит для установки соединения: сервер создает для клиента сегмент общей
+// памяти (memfd) с двумя кольцами и два eventfd, и передает их дескрипторы через
+// SCM_RIGHTS. Дальше запросы и ответы идут через кольца: запись строится прямо в слоте
+// общей памяти и читается оттуда же, без копий через ядро. eventfd дергается, только если
+// читатель уснул. Тот же сокет умеет и обычный обмен запрос/ответ - для сравнения.
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "server.h"
+
+struct IpcRequest {
+    uint64_t id;
+    uint32_t op;
+    uint32_t reserved;
+    double x;
+    double y;
+};
+
+enum class IpcStatus : uint32_t { Ok, Failed };
+
+struct IpcResponse {
+    uint64_t id;
+    IpcStatus status;
+    uint32_t reserved;
+    double value;
+};
+
+// Ограниченная очередь Вьюкова в общей памяти: несколько писателей (воркеры сервера пишут
+// ответы), один читатель. Атомики без блокировок, поэтому работают между процессами
+template<typename Payload, size_t CAPACITY>
+struct ShmRing {
+    struct alignas(64) Slot {
+        std::atomic<uint64_t> seq;
+        Payload payload;
+    };
+
+    alignas(64) std::atomic<uint64_t> head;
+    alignas(64) std::atomic<uint64_t> tail;
+    alignas(64) std::atomic<uint32_t> consumer_sleeping;
+    Slot slots[CAPACITY];
+
+    void init() {
+        head.store(0);
+        tail.store(0);
+        consumer_sleeping.store(0);
+        for (size_t i = 0; i < CAPACITY; ++i)
+            slots[i].seq.store(i);
+    }
+
+    // fill(Payload&) заполняет запись прямо в слоте
+    template<typename Fill>
+    bool try_push(Fill&& fill) {
+        uint64_t pos = head.load(std::memory_order_relaxed);
+        while (true) {
+            Slot& slot = slots[pos % CAPACITY];
+            int64_t dif = static_cast<int64_t>(slot.seq.load(std::memory_order_acquire)) - static_cast<int64_t>(pos);
+            if (dif == 0) {
+                if (head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    fill(slot.payload);
+                    slot.seq.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (dif < 0) {
+                return false;
+            } else {
+                pos = head.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // consume(const Payload&) читает запись прямо из слота. Только один читатель
+    template<typename Consume>
+    bool try_pop(Consume&& consume) {
+        uint64_t pos = tail.load(std::memory_order_relaxed);
+        Slot& slot = slots[pos % CAPACITY];
+        if (slot.seq.load(std::memory_order_acquire) != pos + 1)
+            return false;
+        consume(slot.payload);
+        slot.seq.store(pos + CAPACITY, std::memory_order_release);
+        tail.store(pos + 1, std::memory_order_relaxed);
+        return true;
+    }
+
+    bool empty() const {
+        uint64_t pos = tail.load(std::memory_order_relaxed);
+        return slots[pos % CAPACITY].seq.load(std::memory_order_acquire) != pos + 1;
+    }
+};
+
+constexpr size_t IPC_RING_SIZE = 1024;
+constexpr uint32_t IPC_MAGIC = 0x50415241;  // "PARA"
+constexpr uint32_t IPC_VERSION = 1;
+
+struct IpcChannel {
+    uint32_t magic;
+    uint32_t version;
+    ShmRing<IpcRequest, IPC_RING_SIZE> requests;
+    ShmRing<IpcResponse, IPC_RING_SIZE> responses;
+};
+
+// Писатель после публикации будит читателя, только если тот объявил, что засыпает.
+// Барьеры с обеих сторон исключают потерянное пробуждение
+template<typename Ring>
+void wake_consumer(Ring& ring, int efd) {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (ring.consumer_sleeping.load(std::memory_order_relaxed)) {
+        uint64_t one = 1;
+        [[maybe_unused]] ssize_t n = write(efd, &one, sizeof(one));
+    }
+}
+
+// Возвращает true, если читатель может заснуть (кольцо пусто после объявления)
+template<typename Ring>
+bool prepare_sleep(Ring& ring) {
+    ring.consumer_sleeping.store(1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (!ring.empty()) {
+        ring.consumer_sleeping.store(0, std::memory_order_relaxed);
+        return false;
+    }
+    return true;
+}
+
+inline bool read_full(int fd, void* buf, size_t len) {
+    char* p = static_cast<char*>(buf);
+    while (len > 0) {
+        ssize_t n = read(fd, p, len);
+        if (n <= 0) return false;
+        p += n;
+        len -= n;
+    }
+    return true;
+}
+
+inline bool write_full(int fd, const void* buf, size_t len) {
+    const char* p = static_cast<const char*>(buf);
+    while (len > 0) {
+        ssize_t n = write(fd, p, len);
+        if (n <= 0) return false;
+        p += n;
+        len -= n;
+    }
+    return true;
+}
+
+inline sockaddr_un make_address(const std::string& path) {
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(addr.sun_path))
+        throw std::runtime_error("Socket path is too long: " + path);
+    std::strcpy(addr.sun_path, path.c_str());
+    return addr;
+}
+
+// Владеет дескриптором: закрывает его в деструкторе
+class UniqueFd {
+public:
+    explicit UniqueFd(int fd = -1) : fd(fd) {}
+    UniqueFd(UniqueFd&& other) noexcept : fd(std::exchange(other.fd, -1)) {}
+    UniqueFd& operator=(UniqueFd&& other) noexcept {
+        if (this != &other) {
+            reset();
+            fd = std::exchange(other.fd, -1);
+        }
+        return *this;
+    }
+    ~UniqueFd() { reset(); }
+
+    int get() const { return fd; }
+    void reset() {
+        if (fd >= 0) close(fd);
+        fd = -1;
+    }
+
+private:
+    int fd;
+};
+
+inline std::function<double()> ipc_task(const IpcRequest& req) {
+    switch (static_cast<Op>(req.op)) {
+        case Op::Sin: return std::bind(fun_sin<double>, req.x);
+        case Op::Sqrt: return std::bind(fun_sqrt<double>, req.x);
+        case Op::Pow: return std::bind(fun_pow<double>, req.x, req.y);
+        default: throw std::runtime_error("Unknown opcode!");
+    }
+}
+
+
+// Серверная сторона: принимает клиентов и передает их запросы в Server<double>
+class IpcServer {
+public:
+    IpcServer(Server<double>& server, const std::string& path) : server(server), path(path) {
+        listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        sockaddr_un addr = make_address(path);
+        unlink(path.c_str());
+        if (listen_fd < 0 || bind(listen_fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0
+            || listen(listen_fd, 64) < 0)
+            throw std::runtime_error("Cannot listen on " + path);
+    }
+
+    ~IpcServer() {
+        for (auto& c : connections)
+            c.thread.request_stop();
+        connections.clear();
+        close(listen_fd);
+        unlink(path.c_str());
+    }
+
+    void run(std::stop_token stoken) {
+        while (!stoken.stop_requested()) {
+            pollfd pfd{listen_fd, POLLIN, 0};
+            if (poll(&pfd, 1, 100) <= 0) continue;
+            int fd = accept4(listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+            if (fd < 0) continue;
+            auto conn = std::make_shared<Connection>();
+            conn->sock = fd;
+            if (!conn->setup()) continue;
+            reap();
+            connections.push_back({conn, std::jthread([this, conn](std::stop_token ct) { serve(conn, ct); })});
+        }
+    }
+
+private:
+    struct Connection {
+        int sock = -1;
+        int mem_fd = -1;
+        int req_efd = -1;   // клиент -> сервер
+        int resp_efd = -1;  // сервер -> клиент
+        IpcChannel* channel = nullptr;
+        std::mutex sock_mutex;
+        std::atomic<bool> closed{false};
+
+        // Ответы, которым не хватило места в кольце: воркер не ждет клиента, а оставляет их
+        // потоку соединения. Запросы из кольца принимаются, только пока accepted - delivered
+        // меньше IPC_RING_SIZE, так что отложенных не больше размера кольца
+        std::mutex parked_mutex;
+        std::deque<IpcResponse> parked;
+        std::atomic<uint64_t> delivered{0};  // ответов, положенных в кольцо
+        uint64_t accepted = 0;                // запросов из кольца; только поток соединения
+
+        ~Connection() {
+            if (channel) munmap(channel, sizeof(IpcChannel));
+            for (int fd : {sock, mem_fd, req_efd, resp_efd})
+                if (fd >= 0) close(fd);
+        }
+
+        bool setup() {
+            mem_fd = memfd_create("paralelki-ipc", MFD_CLOEXEC);
+            req_efd = eventfd(0, EFD_CLOEXEC);
+            resp_efd = eventfd(0, EFD_CLOEXEC);
+            if (mem_fd < 0 || req_efd < 0 || resp_efd < 0 || ftruncate(mem_fd, sizeof(IpcChannel)) < 0)
+                return false;
+            void* mem = mmap(nullptr, sizeof(IpcChannel), PROT_READ | PROT_WRITE, MAP_SHARED, mem_fd, 0);
+            if (mem == MAP_FAILED) return false;
+            channel = static_cast<IpcChannel*>(mem);
+            channel->magic = IPC_MAGIC;
+            channel->version = IPC_VERSION;
+            channel->requests.init();
+            channel->responses.init();
+
+            int fds[3] = {mem_fd, req_efd, resp_efd};
+            char byte = 0;
+            iovec iov{&byte, 1};
+            alignas(cmsghdr) char control[CMSG_SPACE(sizeof(fds))];
+            msghdr msg{};
+            msg.msg_iov = &iov;
+            msg.msg_iovlen = 1;
+            msg.msg_control = control;
+            msg.msg_controllen = sizeof(control);
+            cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+            cmsg->cmsg_level = SOL_SOCKET;
+            cmsg->cmsg_type = SCM_RIGHTS;
+            cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+            std::memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+            return sendmsg(sock, &msg, 0) == 1;
+        }
+    };
+
+    struct Worker {
+        std::shared_ptr<Connection> conn;
+        std::jthread thread;
+    };
+
+    Server<double>& server;
+    std::string path;
+    int listen_fd;
+    std::vector<Worker> connections;
+
+    // Потоки отключившихся клиентов: closed ставится последним действием serve, join не ждет
+    void reap() {
+        std::erase_if(connections, [](const Worker& c) { return c.conn->closed.load(); });
+    }
+
+    void submit(const std::shared_ptr<Connection>& conn, const IpcRequest& req, bool via_socket) {
+        uint64_t id = req.id;
+        auto on_done = [conn, id, via_socket](double value, std::exception_ptr err) {
+            IpcResponse resp{id, err ? IpcStatus::Failed : IpcStatus::Ok, 0, value};
+            if (via_socket) {
+                std::lock_guard<std::mutex> lock(conn->sock_mutex);
+                write_full(conn->sock, &resp, sizeof(resp));
+                return;
+            }
+            if (conn->closed) return;
+            std::lock_guard<std::mutex> lock(conn->parked_mutex);
+            if (!conn->parked.empty() || !conn->channel->responses.try_push([&](IpcResponse& slot) { slot = resp; })) {
+                conn->parked.push_back(resp);
+                return;
+            }
+            conn->delivered.fetch_add(1, std::memory_order_release);
+            wake_consumer(conn->channel->responses, conn->resp_efd);
+        };
+        try {
+            server.add_task(ipc_task(req), on_done);
+        } catch (const std::exception&) {
+            on_done(0.0, std::current_exception());
+        }
+    }
+
+    // Перекладывает отложенные ответы в кольцо, сколько поместится. true - отложенных не осталось
+    static bool flush_parked(Connection& conn) {
+        std::lock_guard<std::mutex> lock(conn.parked_mutex);
+        size_t pushed = 0;
+        while (!conn.parked.empty()
+               && conn.channel->responses.try_push([&](IpcResponse& slot) { slot = conn.parked.front(); })) {
+            conn.parked.pop_front();
+            ++pushed;
+        }
+        if (pushed) {
+            conn.delivered.fetch_add(pushed, std::memory_order_release);
+            wake_consumer(conn.channel->responses, conn.resp_efd);
+        }
+        return conn.parked.empty();
+    }
+
+    void serve(std::shared_ptr<Connection> conn, std::stop_token stoken) {
+        auto& requests = conn->channel->requests;
+        while (!stoken.stop_requested()) {
+            IpcRequest req;
+            auto has_room = [&] { return conn->accepted - conn->delivered.load(std::memory_order_acquire) < IPC_RING_SIZE; };
+            while (has_room() && requests.try_pop([&](const IpcRequest& slot) { req = slot; })) {
+                ++conn->accepted;
+                submit(conn, req, false);
+            }
+
+            // Клиент не забирает ответы: новые запросы не принимаем и опрашиваем кольцо
+            // ответов раз в миллисекунду, не засыпая на eventfd запросов
+            bool blocked = !flush_parked(*conn) || !has_room();
+            pollfd pfds[2] = {{conn->sock, POLLIN, 0}, {conn->req_efd, POLLIN, 0}};
+            bool sleep = !blocked && prepare_sleep(requests);
+            int ready = poll(pfds, 2, blocked ? 1 : sleep ? 100 : 0);
+            requests.consumer_sleeping.store(0, std::memory_order_relaxed);
+            if (ready <= 0) continue;
+            if (pfds[1].revents & POLLIN) {
+                uint64_t count;
+                [[maybe_unused]] ssize_t n = read(conn->req_efd, &count, sizeof(count));
+            }
+            if (pfds[0].revents & (POLLIN | POLLHUP)) {
+                if (!read_full(conn->sock, &req, sizeof(req)))
+                    break;  // клиент отключился
+                submit(conn, req, true);
+            }
+        }
+        conn->closed = true;
+    }
+};
+
+
+// Клиентская сторона
+class IpcClient {
+public:
+    explicit IpcClient(const std::string& path) : sock(socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) {
+        sockaddr_un addr = make_address(path);
+        if (sock.get() < 0 || connect(sock.get(), reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0)
+            throw std::runtime_error("Cannot connect to " + path);
+
+        int fds[3];
+        char byte;
+        iovec iov{&byte, 1};
+        alignas(cmsghdr) char control[CMSG_SPACE(sizeof(fds))];
+        msghdr msg{};
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        cmsghdr* cmsg = recvmsg(sock.get(), &msg, MSG_CMSG_CLOEXEC) == 1 ? CMSG_FIRSTHDR(&msg) : nullptr;
+        if (!cmsg || cmsg->cmsg_type != SCM_RIGHTS || cmsg->cmsg_len != CMSG_LEN(sizeof(fds)))
+            throw std::runtime_error("IPC handshake failed");
+        std::memcpy(fds, CMSG_DATA(cmsg), sizeof(fds));
+        mem_fd = UniqueFd(fds[0]);
+        req_efd = UniqueFd(fds[1]);
+        resp_efd = UniqueFd(fds[2]);
+        void* mem = mmap(nullptr, sizeof(IpcChannel), PROT_READ | PROT_WRITE, MAP_SHARED, mem_fd.get(), 0);
+        if (mem == MAP_FAILED)
+            throw std::runtime_error("Cannot map IPC channel");
+        if (static_cast<IpcChannel*>(mem)->magic != IPC_MAGIC || static_cast<IpcChannel*>(mem)->version != IPC_VERSION) {
+            munmap(mem, sizeof(IpcChannel));
+            throw std::runtime_error("IPC protocol mismatch");
+        }
+        channel = static_cast<IpcChannel*>(mem);
+    }
+
+    ~IpcClient() { munmap(channel, sizeof(IpcChannel)); }
+
+    IpcClient(const IpcClient&) = delete;
+    IpcClient& operator=(const IpcClient&) = delete;
+
+    // Кладет запрос в общее кольцо. Не больше IPC_RING_SIZE запросов без ответа
+    uint64_t submit(Op op, double x, double y = 0.0) {
+        if (in_flight >= IPC_RING_SIZE)
+            throw std::runtime_error("Too many requests in flight");
+        uint64_t id = next_id++;
+        while (!channel->requests.try_push([&](IpcRequest& slot) {
+            slot.id = id;
+            slot.op = static_cast<uint32_t>(op);
+            slot.x = x;
+            slot.y = y;
+        }))
+            std::this_thread::yield();
+        ++in_flight;
+        wake_consumer(channel->requests, req_efd.get());
+        return id;
+    }
+
+    bool poll_response(IpcResponse& out) {
+        if (!channel->responses.try_pop([&](const IpcResponse& slot) { out = slot; }))
+            return false;
+        --in_flight;
+        return true;
+    }
+
+    // Короткое ожидание в цикле, затем сон на eventfd
+    IpcResponse wait_response() {
+        IpcResponse resp;
+        for (int spin = 0; spin < 2000; ++spin)
+            if (poll_response(resp)) return resp;
+        while (!poll_response(resp)) {
+            if (!prepare_sleep(channel->responses)) continue;
+            uint64_t count;
+            [[maybe_unused]] ssize_t n = read(resp_efd.get(), &count, sizeof(count));
+            channel->responses.consumer_sleeping.store(0, std::memory_order_relaxed);
+        }
+        return resp;
+    }
+
+    double call(Op op, double x, double y = 0.0) {
+        submit(op, x, y);
+        return checked(wait_response());
+    }
+
+    // Тот же запрос через сокет: копия в ядро и обратно, пробуждение через poll
+    double call_socket(Op op, double x, double y = 0.0) {
+        IpcRequest req{next_id++, static_cast<uint32_t>(op), 0, x, y};
+        IpcResponse resp;
+        if (!write_full(sock.get(), &req, sizeof(req)) || !read_full(sock.get(), &resp, sizeof(resp)))
+            throw std::runtime_error("IPC socket closed");
+        return checked(resp);
+    }
+
+private:
+    UniqueFd sock, mem_fd, req_efd, resp_efd;
+    IpcChannel* channel = nullptr;
+    uint64_t next_id = 0;
+    size_t in_flight = 0;
+
+    static double checked(const IpcResponse& resp) {
+        if (resp.status != IpcStatus::Ok)
+            throw std::runtime_error("Remote task failed");
+        return resp.value;
+    }
+};
@@ -0,0 +1,250 @@
+#include <iostream>
+#include <thread>
+#include <chrono>
+#include <cmath>
+#include <random>
+#include <vector>
+#include <string>
+#include <sstream>
+#include <atomic>
+#include <stdexcept>
+#include <cstdlib>
+#include <algorithm>
+#include <iterator>
+
+#include "server.h"
+
+// Генератор нагрузки с открытым циклом для Server<double>.
+// Клиенты отправляют запросы по расписанию (Пуассон или равномерно), не дожидаясь ответов.
+// Задержка считается от запланированного момента отправки, а не от фактического
+// (поправка на coordinated omission как в wrk2): если генератор отстал, это отставание
+// попадает в задержку.
+//
+// g++ -std=c++20 -O3 -fopenmp loadgen.cpp -o loadgen
+// ./loadgen --rate 200000 --arrival poisson --mix sin:1,sqrt:1,pow:1,spin:0 --cost exp:5
+//           --clients 4 --workers 1 --duration 2 [--capacity N --policy block|fail|shed]
+//           [--priority high:1,normal:8,low:1] [--sweep --slo-us 1000]
+//
+// Задержки пишутся только для успешно выполненных задач; вытесненные (shed), отмененные и
+// упавшие считаются отдельно как failed. --policy shed вытесняет задачи низшего класса,
+// поэтому имеет смысл вместе с --priority, где есть low.
+
+using Clock = std::chrono::steady_clock;
+
+enum class TaskKind { Sin, Sqrt, Pow, Spin, Count };
+
+struct Options {
+    double rate = 100000;          // запросов в секунду на всех клиентов
+    bool poisson = true;
+    double mix[static_cast<size_t>(TaskKind::Count)] = {1, 1, 1, 0};
+    double priority_mix[PRIORITY_COUNT] = {0, 1, 0};
+    bool cost_exponential = false;
+    double cost_us = 1.0;          // средняя стоимость задачи spin
+    int clients = 4;
+    size_t workers = 1;
+    double duration = 2.0;
+    size_t capacity = std::numeric_limits<size_t>::max();
+    OverflowPolicy policy = OverflowPolicy::Block;
+    bool sweep = false;
+    double slo_us = 1000.0;
+};
+
+struct RunResult {
+    double offered;
+    double achieved;
+    size_t sent;
+    size_t completed;
+    size_t failed;      // выполнение закончилось исключением: вытеснена, отменена, упала
+    size_t rejected;
+};
+
+void spin_for(double us) {
+    auto until = Clock::now() + std::chrono::nanoseconds(static_cast<int64_t>(us * 1000));
+    while (Clock::now() < until) {
+    }
+}
+
+std::function<double()> make_task(TaskKind kind, std::mt19937_64& rng, const Options& opt) {
+    std::uniform_int_distribution<int> arg(0, 100), exp_arg(0, 20);
+    switch (kind) {
+        case TaskKind::Sin: return std::bind(fun_sin<double>, double(arg(rng)));
+        case TaskKind::Sqrt: return std::bind(fun_sqrt<double>, double(arg(rng)));
+        case TaskKind::Pow: return std::bind(fun_pow<double>, double(arg(rng)), double(exp_arg(rng)));
+        default: {
+            double cost = opt.cost_exponential
+                ? std::exponential_distribution<double>(1.0 / opt.cost_us)(rng)
+                : opt.cost_us;
+            return [cost] { spin_for(cost); return cost; };
+        }
+    }
+}
+
+RunResult run_load(const Options& opt, double rate, LatencyHistogram& corrected, LatencyHistogram& service) {
+    Server<double> server(opt.workers, opt.capacity, opt.policy);
+    server.start();
+
+    std::atomic<size_t> sent{0}, completed{0}, failed{0}, rejected{0};
+    auto begin = Clock::now() + std::chrono::milliseconds(10);
+    auto end = begin + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(opt.duration));
+    double client_rate = rate / opt.clients;
+
+    std::vector<std::thread> clients;
+    for (int c = 0; c < opt.clients; ++c) {
+        clients.emplace_back([&, c] {
+            std::mt19937_64 rng(12345 + c);
+            std::exponential_distribution<double> gap(client_rate);
+            std::discrete_distribution<int> kind(std::begin(opt.mix), std::end(opt.mix));
+            std::discrete_distribution<int> priority(std::begin(opt.priority_mix), std::end(opt.priority_mix));
+            auto intended = begin;
+
+            while (intended < end) {
+                std::this_thread::sleep_until(intended);
+                auto task = make_task(static_cast<TaskKind>(kind(rng)), rng, opt);
+                auto actual = Clock::now();
+                try {
+                    server.add_task(std::move(task), [&, intended, actual](double, std::exception_ptr error) {
+                        if (error) {
+                            failed.fetch_add(1, std::memory_order_relaxed);
+                            return;
+                        }
+                        auto now = Clock::now();
+                        corrected.record(std::chrono::duration_cast<std::chrono::nanoseconds>(now - intended).count());
+                        service.record(std::chrono::duration_cast<std::chrono::nanoseconds>(now - actual).count());
+                        completed.fetch_add(1, std::memory_order_relaxed);
+                    }, static_cast<Priority>(priority(rng)));
+                    sent.fetch_add(1, std::memory_order_relaxed);
+                } catch (const std::runtime_error&) {
+                    rejected.fetch_add(1, std::memory_order_relaxed);
+                }
+                double dt = opt.poisson ? gap(rng) : 1.0 / client_rate;
+                intended += std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(dt));
+            }
+        });
+    }
+    for (auto& client : clients)
+        client.join();
+
+    // Дожидаемся хвоста, но не бесконечно: при перегрузке очередь может разбираться долго
+    auto drain_until = Clock::now() + std::chrono::seconds(10);
+    while (completed.load() + failed.load() < sent.load() && Clock::now() < drain_until)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    auto finish = Clock::now();
+    server.stop();
+
+    std::chrono::duration<double> elapsed = finish - begin;
+    return {rate, completed / elapsed.count(), sent, completed, failed, rejected};
+}
+
+void print_histogram(const char* name, const LatencyHistogram& hist) {
+    std::cout << name << ": p50=" << hist.percentile(0.5) / 1000.0
+              << "us p90=" << hist.percentile(0.9) / 1000.0
+              << "us p99=" << hist.percentile(0.99) / 1000.0
+              << "us p999=" << hist.percentile(0.999) / 1000.0
+              << "us max=" << hist.percentile(1.0) / 1000.0 << "us\n";
+}
+
+void print_run(const RunResult& r, const LatencyHistogram& corrected, const LatencyHistogram& service) {
+    std::cout << "offered " << r.offered << " req/s, achieved " << r.achieved << " req/s, sent "
+              << r.sent << ", completed " << r.completed << ", failed " << r.failed << ", rejected " << r.rejected << "\n";
+    print_histogram("latency (from intended start)", corrected);
+    print_histogram("service time (from actual send)", service);
+}
+
+// Удваиваем нагрузку, пока сервер успевает и укладывается в SLO по p99
+void sweep(const Options& opt) {
+    double last_ok = 0.0;
+    for (double rate = opt.rate; ; rate *= 2) {
+        LatencyHistogram corrected, service;
+        RunResult r = run_load(opt, rate, corrected, service);
+        print_run(r, corrected, service);
+        bool keeps_up = r.achieved >= 0.95 * rate && r.rejected == 0 && r.failed == 0;
+        bool meets_slo = corrected.percentile(0.99) <= opt.slo_us * 1000;
+        if (!keeps_up || !meets_slo) {
+            std::cout << "saturation: " << last_ok << " req/s within p99 <= " << opt.slo_us
+                      << "us (max achieved " << r.achieved << " req/s)\n";
+            return;
+        }
+        last_ok = rate;
+    }
+}
+
+// Список name:weight; невошедшие имена получают вес 0
+void parse_weights(const std::string& text, const char* const* names, size_t count, double* weights, const char* what) {
+    std::fill(weights, weights + count, 0.0);
+    std::stringstream ss(text);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        auto colon = item.find(':');
+        std::string name = item.substr(0, colon);
+        double weight = colon == std::string::npos ? 1.0 : std::atof(item.c_str() + colon + 1);
+        bool found = false;
+        for (size_t k = 0; k < count; ++k) {
+            if (name == names[k]) {
+                weights[k] = weight;
+                found = true;
+            }
+        }
+        if (!found)
+            throw std::runtime_error(std::string("Unknown ") + what + ": " + name);
+    }
+}
+
+Options parse_args(int argc, char** argv) {
+    Options opt;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        auto value = [&]() -> std::string {
+            if (i + 1 >= argc)
+                throw std::runtime_error("Missing value for " + arg);
+            return argv[++i];
+        };
+        if (arg == "--rate") opt.rate = std::atof(value().c_str());
+        else if (arg == "--arrival") opt.poisson = value() == "poisson";
+        else if (arg == "--mix") {
+            const char* names[] = {"sin", "sqrt", "pow", "spin"};
+            parse_weights(value(), names, std::size(names), opt.mix, "task kind");
+        }
+        else if (arg == "--priority") {
+            const char* names[] = {"high", "normal", "low"};
+            parse_weights(value(), names, std::size(names), opt.priority_mix, "priority");
+        }
+        else if (arg == "--cost") {
+            std::string cost = value();
+            auto colon = cost.find(':');
+            opt.cost_exponential = cost.substr(0, colon) == "exp";
+            opt.cost_us = std::atof(cost.c_str() + (colon == std::string::npos ? 0 : colon + 1));
+        }
+        else if (arg == "--clients") opt.clients = std::atoi(value().c_str());
+        else if (arg == "--workers") opt.workers = std::atoi(value().c_str());
+        else if (arg == "--duration") opt.duration = std::atof(value().c_str());
+        else if (arg == "--capacity") opt.capacity = std::atoll(value().c_str());
+        else if (arg == "--policy") {
+            std::string policy = value();
+            opt.policy = policy == "fail" ? OverflowPolicy::FailFast
+                       : policy == "shed" ? OverflowPolicy::ShedLowest : OverflowPolicy::Block;
+        }
+        else if (arg == "--sweep") opt.sweep = true;
+        else if (arg == "--slo-us") opt.slo_us = std::atof(value().c_str());
+        else throw std::runtime_error("Unknown option: " + arg);
+    }
+    return opt;
+}
+
+int main(int argc, char** argv) {
+    Options opt;
+    try {
+        opt = parse_args(argc, argv);
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << '\n';
+        return 1;
+    }
+
+    if (opt.sweep) {
+        sweep(opt);
+        return 0;
+    }
+    LatencyHistogram corrected, service;
+    RunResult r = run_load(opt, opt.rate, corrected, service);
+    print_run(r, corrected, service);
+    return 0;
+}
@@ -0,0 +1,59 @@
+#include <iostream>
+#include <charconv>
+#include <string>
+#include <string_view>
+
+#include "result_format.h"
+#include "result_writer.h"
+
+// Выгрузка двоичного файла результатов в текст.
+// По умолчанию формат совпадает с Task*.txt (6 значащих цифр), с --exact числа печатаются
+// кратчайшей записью, из которой double восстанавливается точно.
+//
+// g++ -std=c++20 -O2 result_dump.cpp -o result_dump
+// ./result_dump Task1.bin Task1.txt [--exact]
+// ./result_dump Task1.bin --info
+
+int main(int argc, char** argv) {
+    if (argc < 3) {
+        std::cerr << "Usage: " << argv[0] << " <file.bin> <out.txt> [--exact] | <file.bin> --info\n";
+        return 1;
+    }
+    try {
+        ResultReader reader(argv[1]);
+        if (std::string(argv[2]) == "--info") {
+            std::cout << reader.rows() << " rows, " << reader.blocks() << " blocks, "
+                      << reader.file_bytes() << " bytes ("
+                      << double(reader.file_bytes()) / std::max<size_t>(reader.rows(), 1) << " bytes/row)\n";
+            return 0;
+        }
+        bool exact = argc > 3 && std::string(argv[3]) == "--exact";
+
+        ResultFile file(argv[2]);
+        auto out = file.writer();
+        auto put = [&](double value) {
+            if (!exact) {
+                out << value;
+                return;
+            }
+            char buf[32];
+            auto [end, ec] = std::to_chars(buf, buf + sizeof(buf), value);
+            out << std::string_view(buf, end - buf);
+        };
+        reader.for_each([&](ResultOp op, double arg1, double arg2, double result) {
+            out << result_op_name(op) << ' ';
+            put(arg1);
+            if (result_op_arity(op) == 2) {
+                out << ' ';
+                put(arg2);
+            }
+            out << " = ";
+            put(result);
+            out << '\n';
+        });
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << '\n';
+        return 1;
+    }
+    return 0;
+}
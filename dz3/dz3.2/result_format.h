@@ -0,0 +1,381 @@
+#pragma once
+
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Двоичный формат результатов вместо текстовых Task*.txt: значения хранятся точно, без
+// округления до 6 знаков, и читаются без разбора текста.
+//
+// Файл: ResultFileHeader, затем блоки до block_rows строк. Блок: ResultBlockHeader и четыре
+// столбца - коды операций (uint8), arg1, arg2, result (double). Каждый столбец выровнен на 8
+// байт, так что несжатый блок читается прямо из отображенной памяти.
+//
+// Сжатие (флаг BLOCK_COMPRESSED, выбирается для каждого блока): коды операций - пары
+// (код, длина серии), double - XOR с предыдущим значением столбца, у которого отбрасываются
+// нулевые старшие и младшие байты; управляющий байт хранит их число. Целые аргументы и
+// повторяющиеся значения сжимаются до 1-3 байт, без потерь.
+
+enum class ResultOp : uint8_t { Sin, Sqrt, Pow, Count };
+
+inline const char* result_op_name(ResultOp op) {
+    switch (op) {
+        case ResultOp::Sin: return "sin";
+        case ResultOp::Sqrt: return "sqrt";
+        case ResultOp::Pow: return "pow";
+        default: return "?";
+    }
+}
+
+// Число аргументов операции в текстовом виде
+inline int result_op_arity(ResultOp op) { return op == ResultOp::Pow ? 2 : 1; }
+
+constexpr char RESULT_MAGIC[4] = {'D', 'Z', 'R', 'B'};
+constexpr uint32_t RESULT_VERSION = 1;
+constexpr size_t RESULT_COLUMNS = 4;
+constexpr uint32_t BLOCK_COMPRESSED = 1;
+
+struct ResultFileHeader {
+    char magic[4];
+    uint32_t version;
+    uint64_t rows;
+    uint64_t blocks;
+    uint32_t block_rows;
+    uint32_t reserved;
+};
+
+struct ResultBlockHeader {
+    uint32_t rows;
+    uint32_t flags;
+    uint64_t column_bytes[RESULT_COLUMNS];  // без выравнивания
+};
+
+static_assert(sizeof(ResultFileHeader) % 8 == 0 && sizeof(ResultBlockHeader) % 8 == 0);
+
+inline size_t align8(size_t n) { return (n + 7) & ~size_t{7}; }
+
+namespace result_codec {
+
+inline void encode_ops(const std::vector<uint8_t>& ops, std::vector<char>& out) {
+    for (size_t i = 0; i < ops.size();) {
+        uint32_t run = 1;
+        while (i + run < ops.size() && ops[i + run] == ops[i]) ++run;
+        out.push_back(static_cast<char>(ops[i]));
+        char bytes[4];
+        std::memcpy(bytes, &run, 4);
+        out.insert(out.end(), bytes, bytes + 4);
+        i += run;
+    }
+}
+
+inline void decode_ops(const char* in, size_t bytes, uint8_t* ops) {
+    for (const char* end = in + bytes; in < end; in += 5) {
+        uint32_t run;
+        std::memcpy(&run, in + 1, 4);
+        std::memset(ops, static_cast<uint8_t>(in[0]), run);
+        ops += run;
+    }
+}
+
+inline void encode_doubles(const std::vector<double>& values, std::vector<char>& out) {
+    uint64_t prev = 0;
+    for (double v : values) {
+        uint64_t bits = std::bit_cast<uint64_t>(v);
+        uint64_t x = bits ^ prev;
+        prev = bits;
+        int lead = x ? std::countl_zero(x) / 8 : 8;
+        int trail = x ? std::countr_zero(x) / 8 : 0;
+        out.push_back(static_cast<char>(lead << 4 | trail));
+        for (int b = trail; b < 8 - lead; ++b)
+            out.push_back(static_cast<char>(x >> (8 * b)));
+    }
+}
+
+inline void decode_doubles(const char* in, size_t rows, double* values) {
+    uint64_t prev = 0;
+    for (size_t i = 0; i < rows; ++i) {
+        uint8_t control = static_cast<uint8_t>(*in++);
+        int lead = control >> 4, trail = control & 15;
+        uint64_t x = 0;
+        for (int b = trail; b < 8 - lead; ++b)
+            x |= uint64_t(static_cast<uint8_t>(*in++)) << (8 * b);
+        prev ^= x;
+        values[i] = std::bit_cast<double>(prev);
+    }
+}
+
+// Проверки для чтения чужого файла: decode_* доверяют данным и на испорченном блоке
+// вышли бы за буфер или за столбец
+
+// Серии кодов операций покрывают ровно rows строк, коды допустимые
+inline bool check_ops(const char* in, size_t bytes, size_t rows) {
+    if (bytes % 5 != 0) return false;
+    uint64_t total = 0;
+    for (size_t k = 0; k < bytes; k += 5) {
+        uint32_t run;
+        std::memcpy(&run, in + k + 1, 4);
+        total += run;
+        if (static_cast<uint8_t>(in[k]) >= static_cast<uint8_t>(ResultOp::Count) || total > rows)
+            return false;
+    }
+    return total == rows;
+}
+
+// rows значений занимают ровно bytes байт
+inline bool check_doubles(const char* in, size_t bytes, size_t rows) {
+    size_t pos = 0;
+    for (size_t i = 0; i < rows; ++i) {
+        if (pos >= bytes) return false;
+        uint8_t control = static_cast<uint8_t>(in[pos++]);
+        int lead = control >> 4, trail = control & 15;
+        if (lead + trail > 8) return false;
+        pos += 8 - lead - trail;
+    }
+    return pos == bytes;
+}
+
+}  // namespace result_codec
+
+// Пишет файл блоками; заголовок с итоговым числом строк дописывается в close()
+class ResultWriter {
+public:
+    explicit ResultWriter(const std::string& path, bool compress = false, uint32_t block_rows = 4096)
+        : out(path, std::ios::binary | std::ios::trunc), compress(compress), block_rows(block_rows) {
+        if (!out)
+            throw std::runtime_error("Cannot open file: " + path);
+        header = {{RESULT_MAGIC[0], RESULT_MAGIC[1], RESULT_MAGIC[2], RESULT_MAGIC[3]},
+                  RESULT_VERSION, 0, 0, block_rows, 0};
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        ops.reserve(block_rows);
+        args1.reserve(block_rows);
+        args2.reserve(block_rows);
+        results.reserve(block_rows);
+    }
+
+    ~ResultWriter() {
+        try {
+            close();
+        } catch (const std::exception&) {
+        }
+    }
+
+    void add(ResultOp op, double arg1, double arg2, double result) {
+        ops.push_back(static_cast<uint8_t>(op));
+        args1.push_back(arg1);
+        args2.push_back(arg2);
+        results.push_back(result);
+        if (ops.size() == block_rows)
+            flush_block();
+    }
+
+    void close() {
+        if (!out.is_open()) return;
+        flush_block();
+        out.seekp(0);
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        out.close();
+        if (!out)
+            throw std::runtime_error("Failed to write result file");
+    }
+
+private:
+    void flush_block() {
+        if (ops.empty()) return;
+        ResultBlockHeader block{};
+        block.rows = static_cast<uint32_t>(ops.size());
+        block.flags = compress ? BLOCK_COMPRESSED : 0;
+
+        std::vector<char> columns[RESULT_COLUMNS];
+        if (compress) {
+            result_codec::encode_ops(ops, columns[0]);
+            result_codec::encode_doubles(args1, columns[1]);
+            result_codec::encode_doubles(args2, columns[2]);
+            result_codec::encode_doubles(results, columns[3]);
+        } else {
+            auto raw = [](const auto& v, std::vector<char>& col) {
+                const char* p = reinterpret_cast<const char*>(v.data());
+                col.assign(p, p + v.size() * sizeof(v[0]));
+            };
+            raw(ops, columns[0]);
+            raw(args1, columns[1]);
+            raw(args2, columns[2]);
+            raw(results, columns[3]);
+        }
+        for (size_t c = 0; c < RESULT_COLUMNS; ++c)
+            block.column_bytes[c] = columns[c].size();
+
+        static const char zeros[8] = {};
+        out.write(reinterpret_cast<const char*>(&block), sizeof(block));
+        for (const auto& col : columns) {
+            out.write(col.data(), col.size());
+            out.write(zeros, align8(col.size()) - col.size());
+        }
+        header.rows += ops.size();
+        header.blocks += 1;
+        ops.clear();
+        args1.clear();
+        args2.clear();
+        results.clear();
+    }
+
+    std::ofstream out;
+    bool compress;
+    uint32_t block_rows;
+    ResultFileHeader header;
+    std::vector<uint8_t> ops;
+    std::vector<double> args1, args2, results;
+};
+
+// Столбцы одного блока. У несжатых блоков указатели смотрят прямо в отображенный файл
+struct ResultBlockView {
+    size_t rows;
+    const uint8_t* ops;
+    const double* arg1;
+    const double* arg2;
+    const double* result;
+};
+
+// Место для распаковки сжатого блока, одно на поток
+struct ResultBlockBuffer {
+    std::vector<uint8_t> ops;
+    std::vector<double> arg1, arg2, result;
+};
+
+class ResultReader {
+public:
+    explicit ResultReader(const std::string& path) {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            throw std::runtime_error("Cannot open file: " + path);
+        struct stat st;
+        if (fstat(fd, &st) != 0) {
+            ::close(fd);
+            throw std::runtime_error("Cannot stat file: " + path);
+        }
+        size = static_cast<size_t>(st.st_size);
+        if (size < sizeof(ResultFileHeader)) {
+            ::close(fd);
+            throw std::runtime_error("Not a result file: " + path);
+        }
+        void* p = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (p == MAP_FAILED)
+            throw std::runtime_error("Cannot map file: " + path);
+        data = static_cast<const char*>(p);
+        madvise(p, size, MADV_SEQUENTIAL);
+        try {
+            validate();
+        } catch (const std::runtime_error& e) {
+            munmap(p, size);
+            throw std::runtime_error(e.what() + (": " + path));
+        }
+    }
+
+    ~ResultReader() { munmap(const_cast<char*>(data), size); }
+
+    ResultReader(const ResultReader&) = delete;
+    ResultReader& operator=(const ResultReader&) = delete;
+
+    size_t rows() const { return header.rows; }
+    size_t blocks() const { return offsets.size(); }
+    size_t file_bytes() const { return size; }
+
+    ResultBlockView block(size_t index, ResultBlockBuffer& buffer) const {
+        const char* p = data + offsets[index];
+        const auto* block = reinterpret_cast<const ResultBlockHeader*>(p);
+        const char* columns[RESULT_COLUMNS];
+        p += sizeof(ResultBlockHeader);
+        for (size_t c = 0; c < RESULT_COLUMNS; ++c) {
+            columns[c] = p;
+            p += align8(block->column_bytes[c]);
+        }
+        size_t rows = block->rows;
+        if (!(block->flags & BLOCK_COMPRESSED)) {
+            return {rows, reinterpret_cast<const uint8_t*>(columns[0]),
+                    reinterpret_cast<const double*>(columns[1]),
+                    reinterpret_cast<const double*>(columns[2]),
+                    reinterpret_cast<const double*>(columns[3])};
+        }
+        buffer.ops.resize(rows);
+        buffer.arg1.resize(rows);
+        buffer.arg2.resize(rows);
+        buffer.result.resize(rows);
+        result_codec::decode_ops(columns[0], block->column_bytes[0], buffer.ops.data());
+        result_codec::decode_doubles(columns[1], rows, buffer.arg1.data());
+        result_codec::decode_doubles(columns[2], rows, buffer.arg2.data());
+        result_codec::decode_doubles(columns[3], rows, buffer.result.data());
+        return {rows, buffer.ops.data(), buffer.arg1.data(), buffer.arg2.data(), buffer.result.data()};
+    }
+
+    // fn(ResultOp op, double arg1, double arg2, double result) для каждой строки по порядку
+    template <typename Fn>
+    void for_each(Fn fn) const {
+        ResultBlockBuffer buffer;
+        for (size_t b = 0; b < blocks(); ++b) {
+            ResultBlockView view = block(b, buffer);
+            for (size_t i = 0; i < view.rows; ++i)
+                fn(static_cast<ResultOp>(view.ops[i]), view.arg1[i], view.arg2[i], view.result[i]);
+        }
+    }
+
+private:
+    // Проверяет заголовки и размеры всех блоков, чтобы block() мог им доверять: столбцы
+    // лежат внутри файла, несжатые имеют ровно rows элементов, сжатые распаковываются
+    // ровно в rows строк, не выходя за свой столбец
+    void validate() {
+        std::memcpy(&header, data, sizeof(header));
+        if (std::memcmp(header.magic, RESULT_MAGIC, 4) != 0 || header.version != RESULT_VERSION)
+            throw std::runtime_error("Not a result file or unsupported version");
+        size_t offset = sizeof(ResultFileHeader);
+        uint64_t total_rows = 0;
+        for (uint64_t b = 0; b < header.blocks; ++b) {
+            if (size - offset < sizeof(ResultBlockHeader))
+                throw std::runtime_error("Truncated result file");
+            offsets.push_back(offset);
+            ResultBlockHeader block;
+            std::memcpy(&block, data + offset, sizeof(block));
+            offset += sizeof(ResultBlockHeader);
+            const char* columns[RESULT_COLUMNS];
+            for (size_t c = 0; c < RESULT_COLUMNS; ++c) {
+                if (block.column_bytes[c] > size - offset || align8(block.column_bytes[c]) > size - offset)
+                    throw std::runtime_error("Truncated result file");
+                columns[c] = data + offset;
+                offset += align8(block.column_bytes[c]);
+            }
+            size_t rows = block.rows;
+            if (block.flags & BLOCK_COMPRESSED) {
+                if (!result_codec::check_ops(columns[0], block.column_bytes[0], rows))
+                    throw std::runtime_error("Corrupt operation column in block " + std::to_string(b));
+                for (size_t c = 1; c < RESULT_COLUMNS; ++c)
+                    if (!result_codec::check_doubles(columns[c], block.column_bytes[c], rows))
+                        throw std::runtime_error("Corrupt value column in block " + std::to_string(b));
+            } else {
+                if (block.column_bytes[0] != rows)
+                    throw std::runtime_error("Bad operation column size in block " + std::to_string(b));
+                for (size_t c = 1; c < RESULT_COLUMNS; ++c)
+                    if (block.column_bytes[c] != rows * sizeof(double))
+                        throw std::runtime_error("Bad value column size in block " + std::to_string(b));
+                for (size_t i = 0; i < rows; ++i)
+                    if (static_cast<uint8_t>(columns[0][i]) >= static_cast<uint8_t>(ResultOp::Count))
+                        throw std::runtime_error("Bad operation code in block " + std::to_string(b));
+            }
+            total_rows += rows;
+        }
+        if (total_rows != header.rows)
+            throw std::runtime_error("Row count mismatch");
+    }
+
+    const char* data = nullptr;
+    size_t size = 0;
+    ResultFileHeader header;
+    std::vector<size_t> offsets;
+};
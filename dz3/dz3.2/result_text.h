@@ -0,0 +1,66 @@
+#pragma once
+
+#include <algorithm>
+#include <charconv>
+#include <stdexcept>
+#include <string>
+
+#include "result_format.h"
+
+// Разбор строк Task*.txt вида "pow 62 14 = 1.24e+25" без потоков ввода и сравнения строк
+
+struct ResultRow {
+    ResultOp operation;
+    double arg1;
+    double arg2;
+    double result;
+};
+
+inline const char* skip_spaces(const char* p, const char* end) {
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\r')) ++p;
+    return p;
+}
+
+inline const char* parse_number(const char* p, const char* end, double& value) {
+    p = skip_spaces(p, end);
+    auto [next, ec] = std::from_chars(p, end, value);
+    if (ec != std::errc())
+        throw std::runtime_error("Bad number: " + std::string(p, std::find(p, end, '\n')));
+    return next;
+}
+
+// Имя операции распознается по первым буквам: sin, sqrt, pow
+inline const char* parse_op(const char* p, const char* end, ResultOp& op) {
+    size_t left = end - p;
+    if (left >= 4 && p[0] == 's' && p[1] == 'i' && p[2] == 'n' && p[3] == ' ') {
+        op = ResultOp::Sin;
+        return p + 3;
+    }
+    if (left >= 5 && p[0] == 's' && p[1] == 'q' && p[2] == 'r' && p[3] == 't' && p[4] == ' ') {
+        op = ResultOp::Sqrt;
+        return p + 4;
+    }
+    if (left >= 4 && p[0] == 'p' && p[1] == 'o' && p[2] == 'w' && p[3] == ' ') {
+        op = ResultOp::Pow;
+        return p + 3;
+    }
+    throw std::runtime_error("Unknown operation: " + std::string(p, std::find(p, end, '\n')));
+}
+
+// Разбирает строку, начинающуюся в p, и возвращает указатель на начало следующей
+inline const char* parse_result_line(const char* p, const char* end, ResultRow& row) {
+    const char* line = p;
+    row.arg2 = 0.0;
+    p = parse_op(p, end, row.operation);
+    p = parse_number(p, end, row.arg1);
+    if (row.operation == ResultOp::Pow)
+        p = parse_number(p, end, row.arg2);
+    p = skip_spaces(p, end);
+    if (p == end || *p != '=')
+        throw std::runtime_error("Expected '=': " + std::string(line, std::find(line, end, '\n')));
+    p = parse_number(p + 1, end, row.result);
+    p = skip_spaces(p, end);
+    if (p < end && *p != '\n')
+        throw std::runtime_error("Trailing characters: " + std::string(line, std::find(line, end, '\n')));
+    return p < end ? p + 1 : p;
+}
@@ -0,0 +1,214 @@
+#pragma once
+
+#include <cerrno>
+#include <charconv>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+// Асинхронная запись результатов в файл. Каждый поток пишет в свой буфер через Writer,
+// заполненные буферы уходят фоновому потоку, который сбрасывает их крупными write().
+// Строки не разрываются между буферами, поэтому строки разных потоков не перемешиваются.
+// Числа форматируются std::to_chars так же, как std::ostream по умолчанию (%g, 6 знаков).
+//
+//   ResultFile file("Task1.txt");
+//   auto out = file.writer();
+//   out << "sin " << arg << " = " << value << '\n';
+
+class ResultFile {
+public:
+    class Writer;
+
+    explicit ResultFile(const std::string& path, size_t buffer_size = 1 << 20, size_t max_pending = 4)
+        : buffer_size(buffer_size), max_pending(max_pending) {
+        fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0)
+            throw std::runtime_error("Cannot open file: " + path);
+        flusher = std::thread(&ResultFile::flush_loop, this);
+    }
+
+    ~ResultFile() {
+        try {
+            close();
+        } catch (const std::exception&) {
+        }
+    }
+
+    ResultFile(const ResultFile&) = delete;
+    ResultFile& operator=(const ResultFile&) = delete;
+
+    Writer writer();
+
+    // Дожидается записи всех переданных буферов. Writer'ы должны быть уничтожены раньше
+    void close() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (closed) return;
+            closed = true;
+        }
+        cv.notify_all();
+        flusher.join();
+        ::close(fd);
+        if (!error.empty())
+            throw std::runtime_error(error);
+    }
+
+    size_t bytes_written() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return written;
+    }
+
+private:
+    // Отдает заполненный буфер фоновому потоку и возвращает пустой на замену.
+    // Если запись отстает, ждет: в памяти не больше max_pending буферов
+    std::vector<char> submit(std::vector<char> full) {
+        std::unique_lock<std::mutex> lock(mutex);
+        space_cv.wait(lock, [this] { return pending.size() < max_pending; });
+        if (!full.empty()) {
+            pending.push_back(std::move(full));
+            cv.notify_one();
+        }
+        std::vector<char> empty;
+        if (!spare.empty()) {
+            empty = std::move(spare.back());
+            spare.pop_back();
+        }
+        empty.clear();
+        empty.reserve(buffer_size);
+        return empty;
+    }
+
+    void flush_loop() {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            cv.wait(lock, [this] { return !pending.empty() || closed; });
+            if (pending.empty()) break;
+            std::vector<char> buffer = std::move(pending.front());
+            pending.pop_front();
+            lock.unlock();
+            write_all(buffer.data(), buffer.size());
+            lock.lock();
+            written += buffer.size();
+            spare.push_back(std::move(buffer));
+            space_cv.notify_all();
+        }
+    }
+
+    void write_all(const char* data, size_t size) {
+        while (size > 0) {
+            ssize_t n = ::write(fd, data, size);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                std::lock_guard<std::mutex> lock(mutex);
+                error = std::string("write failed: ") + std::strerror(errno);
+                return;
+            }
+            data += n;
+            size -= static_cast<size_t>(n);
+        }
+    }
+
+    int fd = -1;
+    size_t buffer_size;
+    size_t max_pending;
+    mutable std::mutex mutex;
+    std::condition_variable cv;        // есть буферы для записи или файл закрывается
+    std::condition_variable space_cv;  // освободилось место в очереди
+    std::deque<std::vector<char>> pending;
+    std::vector<std::vector<char>> spare;
+    size_t written = 0;
+    bool closed = false;
+    std::string error;
+    std::thread flusher;
+};
+
+// Буфер одного потока. Остаток отдается на запись в деструкторе
+class ResultFile::Writer {
+public:
+    explicit Writer(ResultFile& file) : file(&file), buffer(file.submit({})) {}
+
+    Writer(Writer&& other) noexcept
+        : file(other.file), buffer(std::move(other.buffer)), line_start(other.line_start) {
+        other.file = nullptr;
+    }
+
+    ~Writer() {
+        if (file && !buffer.empty())
+            file->submit(std::move(buffer));
+    }
+
+    Writer& operator<<(std::string_view text) {
+        reserve(text.size());
+        buffer.insert(buffer.end(), text.begin(), text.end());
+        size_t newline = text.rfind('\n');
+        if (newline != std::string_view::npos)
+            line_start = buffer.size() - text.size() + newline + 1;
+        return *this;
+    }
+
+    Writer& operator<<(char c) {
+        reserve(1);
+        buffer.push_back(c);
+        if (c == '\n')
+            line_start = buffer.size();
+        return *this;
+    }
+
+    Writer& operator<<(double value) {
+        return put_chars([value](char* first, char* last) {
+            return std::to_chars(first, last, value, std::chars_format::general, 6);
+        });
+    }
+
+    template <typename Int, typename = std::enable_if_t<std::is_integral_v<Int>>>
+    Writer& operator<<(Int value) {
+        return put_chars([value](char* first, char* last) { return std::to_chars(first, last, value); });
+    }
+
+private:
+    static constexpr size_t MAX_NUMBER_CHARS = 32;
+
+    template <typename Format>
+    Writer& put_chars(Format format) {
+        reserve(MAX_NUMBER_CHARS);
+        size_t size = buffer.size();
+        buffer.resize(size + MAX_NUMBER_CHARS);
+        auto [end, ec] = format(buffer.data() + size, buffer.data() + buffer.size());
+        buffer.resize(end - buffer.data());
+        return *this;
+    }
+
+    // Если строка не помещается в буфер, отправляем только завершенные строки,
+    // а начатую переносим в новый буфер
+    void reserve(size_t extra) {
+        if (buffer.size() + extra <= buffer.capacity())
+            return;
+        if (line_start == 0) {
+            buffer.reserve(2 * (buffer.size() + extra));
+            return;
+        }
+        std::vector<char> tail(buffer.begin() + line_start, buffer.end());
+        buffer.resize(line_start);
+        buffer = file->submit(std::move(buffer));
+        buffer.insert(buffer.end(), tail.begin(), tail.end());
+        line_start = 0;
+    }
+
+    ResultFile* file;
+    std::vector<char> buffer;
+    size_t line_start = 0;
+};
+
+inline ResultFile::Writer ResultFile::writer() {
+    return Writer(*this);
+}
@@ -0,0 +1,1646 @@
+#pragma once
+
+#include <iostream>
+#include <queue>
+#include <future>
+#include <thread>
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <unordered_map>
+#include <optional>
+#include <vector>
+#include <deque>
+#include <atomic>
+#include <algorithm>
+#include <bit>
+#include <memory>
+#include <coroutine>
+#include <exception>
+#include <array>
+#include <ostream>
+#include <limits>
+#include <stdexcept>
+#include <cstdint>
+#include <unordered_set>
+#include <stop_token>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+#include "../../common/trace.h"
+
+template<typename T>
+T fun_sin(T arg) {
+    return std::sin(arg);
+}
+
+template<typename T>
+T fun_sqrt(T arg) {
+    return std::sqrt(arg);
+}
+
+template<typename T>
+T fun_pow(T x, T y) {
+    return std::pow(x, y);
+}
+
+
+using Clock = std::chrono::steady_clock;
+
+// Классы приоритета. Normal - класс по умолчанию, он идет по обычной FIFO очереди
+enum class Priority : uint8_t { High, Normal, Low, Count };
+
+constexpr size_t PRIORITY_COUNT = static_cast<size_t>(Priority::Count);
+
+inline const char* priority_name(Priority priority) {
+    switch (priority) {
+        case Priority::High: return "high";
+        case Priority::Normal: return "normal";
+        default: return "low";
+    }
+}
+
+// Гистограмма задержек в стиле HdrHistogram: на каждую степень двойки 2^SUB_BITS линейных
+// корзин, относительная погрешность ~3%. Счетчики атомарные, запись без блокировок
+class LatencyHistogram {
+public:
+    static constexpr int SUB_BITS = 5;
+    static constexpr uint64_t SUB_COUNT = 1 << SUB_BITS;
+    static constexpr size_t BUCKETS = (64 - SUB_BITS + 1) * SUB_COUNT;
+
+    void record(uint64_t value) {
+        counts[index_of(value)].fetch_add(1, std::memory_order_relaxed);
+        total.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // Для гистограмм с единственным писателем: обычные load/store без lock-префикса,
+    // читатели при этом видят согласованные (пусть и чуть устаревшие) значения
+    void record_single_writer(uint64_t value) {
+        auto& bucket = counts[index_of(value)];
+        bucket.store(bucket.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        total.store(total.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+
+    uint64_t count() const { return total.load(std::memory_order_relaxed); }
+
+    uint64_t percentile(double q) const {
+        uint64_t n = count();
+        if (n == 0) return 0;
+        uint64_t target = std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(q * n)));
+        uint64_t seen = 0;
+        for (size_t i = 0; i < BUCKETS; ++i) {
+            seen += counts[i].load(std::memory_order_relaxed);
+            if (seen >= target) return value_at(i);
+        }
+        return value_at(BUCKETS - 1);
+    }
+
+private:
+    std::array<std::atomic<uint64_t>, BUCKETS> counts{};
+    std::atomic<uint64_t> total{0};
+
+    static size_t index_of(uint64_t value) {
+        if (value < SUB_COUNT) return value;
+        int shift = 63 - std::countl_zero(value) - SUB_BITS;
+        return (shift + 1) * SUB_COUNT + ((value >> shift) - SUB_COUNT);
+    }
+
+    // Середина корзины
+    static uint64_t value_at(size_t index) {
+        if (index < SUB_COUNT) return index;
+        int shift = static_cast<int>(index / SUB_COUNT) - 1;
+        uint64_t mantissa = SUB_COUNT + index % SUB_COUNT;
+        return (mantissa << shift) + ((uint64_t{1} << shift) >> 1);
+    }
+};
+
+// Что делать, когда очередь заполнена
+enum class OverflowPolicy : uint8_t {
+    Block,       // ждать, пока освободится место
+    FailFast,    // сразу отказать
+    ShedLowest,  // выбросить старейшую задачу более низкого класса, иначе отказать
+};
+
+// Поведение воркера без работы: spin проверок очереди с pause, затем yields уступок
+// процессора, затем сон на cond_var (в glibc это futex). Нули - сразу засыпать
+struct IdlePolicy {
+    uint32_t spin = 256;
+    uint32_t yields = 16;
+
+    // На одном ядре ожидающий воркер только отнимает время у того, кто ставит задачи,
+    // а yield отдает целый квант соседнему вычислительному потоку
+    static IdlePolicy for_this_machine() {
+        return std::thread::hardware_concurrency() > 1 ? IdlePolicy{} : IdlePolicy{0, 0};
+    }
+};
+
+inline void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+    _mm_pause();
+#endif
+}
+
+enum class SubmitStatus : uint8_t { Ok, QueueFull, Stopped };
+
+// Cancelled - задачу отменили или вытеснили из очереди, результата не будет
+enum class ResultStatus : uint8_t { Ready, Timeout, Cancelled };
+
+// Учет работы, выброшенной из-за отмены
+struct CancelStats {
+    uint64_t requested;   // вызовов cancel для незавершенных задач
+    uint64_t skipped;     // сняты при извлечении из очереди и не выполнялись
+    uint64_t running;     // отмена пришла во время выполнения
+    uint64_t wasted_ns;   // время выполнения задач, результат которых уже никому не нужен
+};
+
+struct LatencySummary {
+    uint64_t count;
+    uint64_t p50_ns;
+    uint64_t p99_ns;
+    uint64_t p999_ns;
+};
+
+// Снимок статистики одного воркера. queue - от постановки в очередь до извлечения,
+// exec - выполнение (для пакета типизированных запросов - доля на один запрос)
+struct WorkerSnapshot {
+    uint64_t tasks;
+    uint64_t batches;
+    uint64_t busy_ns;
+    LatencySummary queue;
+    LatencySummary exec;
+};
+
+struct ServerStats {
+    std::vector<WorkerSnapshot> workers;
+    uint64_t tasks;
+    size_t queue_depth;
+    size_t rejected;
+    size_t shed;
+    size_t deadline_misses;
+    double uptime_s;
+};
+
+template<typename T>
+struct Job {
+    size_t id = 0;
+    std::packaged_task<T()> task;
+    Priority priority = Priority::Normal;
+    Clock::time_point submitted;
+    Clock::time_point deadline = Clock::time_point::max();
+    bool cancellable = false;
+    // Для задач с callback: вызывается, если задачу выбросили, не выполнив
+    std::function<void(std::exception_ptr)> on_abandon;
+};
+
+// Для std::push_heap: наверху кучи задача с самым ранним дедлайном (EDF)
+struct LaterDeadline {
+    template<typename T>
+    bool operator()(const Job<T>& a, const Job<T>& b) const {
+        return a.deadline > b.deadline;
+    }
+};
+
+// Типизированные запросы: клиент передает (opcode, аргументы), а не замыкание
+enum class Op : uint8_t { Sin, Sqrt, Pow, Count };
+
+constexpr size_t OP_COUNT = static_cast<size_t>(Op::Count);
+
+template<typename T>
+struct OpRequest {
+    size_t id;
+    Op op;
+    T x;
+    T y;
+    std::promise<T> promise;
+    Clock::time_point submitted;
+};
+
+// Пакетные ядра. Векторные sin/pow из libmvec glibc объявляет только под -ffast-math, а
+// std::sqrt без -fno-math-errno не векторизуется: при сборке с -O3 -fopenmp без них циклы
+// остаются скалярными и пакет ничего не дает. Поэтому dz3.2.1.cpp собирается с -ffast-math
+template<typename T>
+void batch_sin(const T* x, T* res, size_t n) {
+    #pragma omp simd
+    for (size_t i = 0; i < n; ++i)
+        res[i] = std::sin(x[i]);
+}
+
+template<typename T>
+void batch_sqrt(const T* x, T* res, size_t n) {
+    #pragma omp simd
+    for (size_t i = 0; i < n; ++i)
+        res[i] = std::sqrt(x[i]);
+}
+
+template<typename T>
+void batch_pow(const T* x, const T* y, T* res, size_t n) {
+    #pragma omp simd
+    for (size_t i = 0; i < n; ++i)
+        res[i] = std::pow(x[i], y[i]);
+}
+
+template<typename T>
+void eval_batch(Op op, const T* x, const T* y, T* res, size_t n) {
+    switch (op) {
+        case Op::Sin:  batch_sin(x, res, n); break;
+        case Op::Sqrt: batch_sqrt(x, res, n); break;
+        case Op::Pow:  batch_pow(x, y, res, n); break;
+        default: throw std::runtime_error("Unknown opcode!");
+    }
+}
+
+
+// Кэш результатов чистых функций. Ключ - (id функции, аргументы), сравнение по битам,
+// чтобы sin(-0.0) и sin(0.0) не склеивались. Шарды со своим мьютексом, вытеснение CLOCK
+template<typename T>
+struct MemoKey {
+    uint32_t fn_id;
+    uint64_t x;
+    uint64_t y;
+
+    bool operator==(const MemoKey&) const = default;
+};
+
+template<typename T>
+uint64_t to_bits(T value) {
+    if constexpr (sizeof(T) == sizeof(uint32_t))
+        return std::bit_cast<uint32_t>(value);
+    else
+        return std::bit_cast<uint64_t>(value);
+}
+
+template<typename T>
+MemoKey<T> make_key(uint32_t fn_id, T x, T y) {
+    return {fn_id, to_bits(x), to_bits(y)};
+}
+
+struct MemoKeyHash {
+    template<typename T>
+    size_t operator()(const MemoKey<T>& key) const {
+        uint64_t h = key.x * 0x9E3779B97F4A7C15ull;
+        h ^= (key.y + 0x632BE59BD9B4E019ull + (h << 6) + (h >> 2));
+        h ^= key.fn_id * 0xC2B2AE3D27D4EB4Full;
+        return h ^ (h >> 29);
+    }
+};
+
+template<typename T>
+class MemoCache {
+public:
+    explicit MemoCache(size_t capacity, size_t nshards = 16)
+        : nshards(nshards), shard_capacity(std::max<size_t>(1, capacity / nshards)),
+          shards(std::make_unique<Shard[]>(nshards)) {}
+
+    bool lookup(const MemoKey<T>& key, T& value) {
+        Shard& shard = shard_for(key);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto it = shard.index.find(key);
+        if (it == shard.index.end()) {
+            miss_count.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        Entry& entry = shard.slots[it->second];
+        entry.referenced = true;
+        value = entry.value;
+        hit_count.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    void insert(const MemoKey<T>& key, T value) {
+        Shard& shard = shard_for(key);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto it = shard.index.find(key);
+        if (it != shard.index.end()) {
+            shard.slots[it->second].value = value;
+            return;
+        }
+        if (shard.slots.size() < shard_capacity) {
+            shard.index.emplace(key, shard.slots.size());
+            shard.slots.push_back({key, value, false});
+            return;
+        }
+        // CLOCK: снимаем бит обращения, пока не найдем запись без него
+        while (shard.slots[shard.hand].referenced) {
+            shard.slots[shard.hand].referenced = false;
+            shard.hand = (shard.hand + 1) % shard.slots.size();
+        }
+        Entry& victim = shard.slots[shard.hand];
+        shard.index.erase(victim.key);
+        victim = {key, value, false};
+        shard.index.emplace(key, shard.hand);
+        shard.hand = (shard.hand + 1) % shard.slots.size();
+        eviction_count.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    size_t hits() const { return hit_count.load(std::memory_order_relaxed); }
+    size_t misses() const { return miss_count.load(std::memory_order_relaxed); }
+    size_t evictions() const { return eviction_count.load(std::memory_order_relaxed); }
+
+private:
+    struct Entry {
+        MemoKey<T> key;
+        T value;
+        bool referenced;
+    };
+
+    struct Shard {
+        std::mutex mutex;
+        std::vector<Entry> slots;
+        std::unordered_map<MemoKey<T>, size_t, MemoKeyHash> index;
+        size_t hand = 0;
+    };
+
+    size_t nshards;
+    size_t shard_capacity;
+    std::unique_ptr<Shard[]> shards;
+    std::atomic<size_t> hit_count{0}, miss_count{0}, eviction_count{0};
+
+    Shard& shard_for(const MemoKey<T>& key) {
+        return shards[MemoKeyHash{}(key) % nshards];
+    }
+};
+
+
+// Небольшой планировщик для корутин клиентов: пул потоков с общей очередью хэндлов
+class Scheduler {
+public:
+    explicit Scheduler(size_t nthreads) {
+        for (size_t i = 0; i < nthreads; ++i)
+            threads.emplace_back([this](std::stop_token stoken) { run(stoken); });
+    }
+
+    ~Scheduler() {
+        for (auto& thread : threads)
+            thread.request_stop();
+        cond_var.notify_all();
+    }
+
+    void post(std::coroutine_handle<> handle) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            ready.push_back(handle);
+        }
+        cond_var.notify_one();
+    }
+
+private:
+    std::mutex mutex;
+    std::condition_variable_any cond_var;
+    std::deque<std::coroutine_handle<>> ready;
+    std::vector<std::jthread> threads;
+
+    void run(std::stop_token stoken) {
+        while (true) {
+            std::coroutine_handle<> handle;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                if (!cond_var.wait(lock, stoken, [this] { return !ready.empty(); }))
+                    return;
+                handle = ready.front();
+                ready.pop_front();
+            }
+            handle.resume();
+        }
+    }
+};
+
+// Корутина клиента без возвращаемого значения. Стартует, когда ее отдают в Scheduler::spawn
+struct ClientTask {
+    struct promise_type {
+        ClientTask get_return_object() {
+            return {std::coroutine_handle<promise_type>::from_promise(*this)};
+        }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { std::terminate(); }
+    };
+
+    std::coroutine_handle<promise_type> handle;
+};
+
+inline void spawn(Scheduler& scheduler, ClientTask task) {
+    scheduler.post(task.handle);
+}
+
+template<typename T>
+class SubmitAwaiter;
+
+
+template <typename T>
+class Server {
+public:
+    static constexpr size_t BATCH_SIZE = 64;
+
+    explicit Server(size_t nworkers = 1, size_t capacity = std::numeric_limits<size_t>::max(),
+                    OverflowPolicy policy = OverflowPolicy::Block)
+        : nworkers(nworkers), capacity(capacity), policy(policy), active_workers(nworkers),
+          worker_stats(std::make_unique<WorkerStats[]>(nworkers)), started(Clock::now()) {}
+
+    ~Server() {
+        stop();
+        {
+            std::lock_guard<std::mutex> lock(result_mutex);
+            results.clear();
+        }
+    }
+
+    // Включает кэш для чистых функций: типизированных запросов и зарегистрированных
+    // через register_pure. Вызывать до start()
+    void enable_memo(size_t capacity) {
+        memo = std::make_unique<MemoCache<T>>(capacity);
+    }
+
+    size_t memo_hits() const { return memo ? memo->hits() : 0; }
+    size_t memo_misses() const { return memo ? memo->misses() : 0; }
+
+    // Регистрирует чистую функцию двух аргументов и возвращает ее id. Вызывать до start()
+    uint32_t register_pure(std::function<T(T, T)> fn) {
+        pure_funcs.push_back(std::move(fn));
+        return static_cast<uint32_t>(OP_COUNT + pure_funcs.size() - 1);
+    }
+
+    void start() {
+        for (size_t i = 0; i < nworkers; ++i)
+            workers.emplace_back(&Server::server_loop, this, stop_src.get_token(), i);
+        if (min_workers < nworkers)
+            scaler_thread = std::jthread([this](std::stop_token stoken) { scaler_loop(stoken); });
+    }
+
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(queue_mutex);
+            stop_src.request_stop();
+        }
+        cond_var.notify_all();
+        space_cv.notify_all();
+        scale_cv.notify_all();
+        if (scaler_thread.joinable()) {
+            scaler_thread.request_stop();
+            scaler_thread.join();
+        }
+        if (stats_thread.joinable()) {
+            stats_thread.request_stop();
+            stats_thread.join();
+        }
+        if (workers.empty()) return;
+        for (auto& worker : workers) {
+            if (worker.joinable()) {
+                worker.join();
+            }
+        }
+        workers.clear();
+        std::cout << "Server stopped.\n";
+    }
+
+    size_t add_task(std::function<double()> task) {
+        return add_task(std::move(task), Priority::Normal);
+    }
+
+    // Класс High обслуживается по EDF; промахи дедлайна считаются для всех классов
+    // При переполнении ведет себя по OverflowPolicy; отказ выражается исключением
+    size_t add_task(std::function<double()> task, Priority priority,
+                    std::optional<Clock::duration> deadline = std::nullopt) {
+        size_t task_id;
+        throw_on_error(submit_job(std::move(task), priority, deadline, true, task_id));
+        return task_id;
+    }
+
+    // Никогда не блокируется: при полной очереди возвращает QueueFull
+    SubmitStatus try_add_task(std::function<double()> task, size_t& task_id,
+                              Priority priority = Priority::Normal,
+                              std::optional<Clock::duration> deadline = std::nullopt) {
+        return submit_job(std::move(task), priority, deadline, false, task_id);
+    }
+
+    // Завершение через callback: результат не попадает в results, воркер отдает его сразу
+    void add_task(std::function<T()> task, std::function<void(T, std::exception_ptr)> on_done,
+                  Priority priority = Priority::Normal) {
+        auto done = std::make_shared<std::function<void(T, std::exception_ptr)>>(std::move(on_done));
+        std::packaged_task<T()> packaged_task([task = std::move(task), done] {
+            T value;
+            try {
+                value = task();
+            } catch (...) {
+                (*done)(T{}, std::current_exception());
+                throw;
+            }
+            (*done)(value, nullptr);
+            return value;
+        });
+        Job<T> job = make_job(std::move(packaged_task), priority, std::nullopt);
+        job.on_abandon = [done](std::exception_ptr error) { (*done)(T{}, error); };
+        throw_on_error(enqueue(std::move(job), true));
+    }
+
+    // co_await server.submit(fn): корутина продолжится в воркере или, если задан executor, в нем
+    SubmitAwaiter<T> submit(std::function<T()> task, Scheduler* executor = nullptr) {
+        return SubmitAwaiter<T>(*this, std::move(task), executor);
+    }
+
+    size_t add_op(Op op, T x, T y = T{}) {
+        if (static_cast<size_t>(op) >= OP_COUNT)
+            throw std::runtime_error("Unknown opcode!");
+        if (op != Op::Pow) y = T{};  // у унарных операций второй аргумент не влияет на ключ
+        T cached;
+        if (memo && memo->lookup(make_key(static_cast<uint32_t>(op), x, y), cached))
+            return add_ready(cached);
+
+        size_t task_id = task_counter++;
+        std::promise<T> promise;
+        std::future<T> result = promise.get_future();
+        std::vector<Job<T>> victims;
+        {
+            std::unique_lock<std::mutex> lock(queue_mutex);
+            SubmitStatus status = admit(lock, Priority::Normal, true, victims);
+            if (status == SubmitStatus::Ok)
+                op_tasks[static_cast<size_t>(op)].push_back({task_id, op, x, y, std::move(promise), Clock::now()});
+            lock.unlock();
+            abandon_all(victims);
+            throw_on_error(status);
+        }
+        cond_var.notify_one();
+        {
+            std::lock_guard<std::mutex> lock(result_mutex);
+            results[task_id] = std::move(result);
+        }
+        return task_id;
+    }
+
+    // Задача, которая может досрочно завершиться по токену, если ее отменят во время выполнения
+    size_t add_cancellable_task(std::function<T(std::stop_token)> task,
+                                Priority priority = Priority::Normal,
+                                std::optional<Clock::duration> deadline = std::nullopt) {
+        std::stop_source source;
+        std::stop_token token = source.get_token();
+        Job<T> job = make_job(std::packaged_task<T()>([task = std::move(task), token] { return task(token); }),
+                              priority, deadline);
+        job.cancellable = true;
+        std::future<T> result = job.task.get_future();
+        size_t task_id = job.id;
+        {
+            std::lock_guard<std::mutex> lock(cancel_mutex);
+            stop_sources.emplace(task_id, std::move(source));
+        }
+        SubmitStatus status = enqueue(std::move(job), true);
+        if (status != SubmitStatus::Ok) {
+            forget_stop_source(task_id);
+            throw_on_error(status);
+        }
+        std::lock_guard<std::mutex> lock(result_mutex);
+        results[task_id] = std::move(result);
+        return task_id;
+    }
+
+    // Отменяет задачу: из очереди она будет снята без выполнения, выполняющаяся получит
+    // запрос остановки через stop_token. Результат отмененной задачи больше нельзя запросить.
+    // Возвращает false, если задача уже завершилась (результат тогда остается у клиента) или ее результат нельзя запросить
+    // (неизвестный или уже забранный id, задача с callback)
+    bool cancel(size_t task_id) {
+        std::shared_future<T> result;
+        {
+            // Готовый результат остается клиенту: убираем его, только если отмена состоится
+            std::lock_guard<std::mutex> lock(result_mutex);
+            auto it = results.find(task_id);
+            if (it == results.end() || is_ready(it->second))
+                return false;
+            result = it->second;
+        }
+        {
+            std::lock_guard<std::mutex> lock(cancel_mutex);
+            cancelled.insert(task_id);
+            cancelled_pending.store(cancelled.size(), std::memory_order_seq_cst);
+            // Воркер, завершивший задачу между проверками, мог не увидеть запись выше: тогда
+            // id никто не снимет. Парный барьер стоит в воркере перед take_cancelled после выполнения
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (is_ready(result)) {
+                cancelled.erase(task_id);
+                cancelled_pending.store(cancelled.size(), std::memory_order_release);
+                return false;
+            }
+            auto source = stop_sources.find(task_id);
+            if (source != stop_sources.end())
+                source->second.request_stop();
+        }
+        cancel_requested.fetch_add(1, std::memory_order_relaxed);
+        std::lock_guard<std::mutex> lock(result_mutex);
+        results.erase(task_id);
+        return true;
+    }
+
+    CancelStats cancel_stats() const {
+        return {cancel_requested.load(std::memory_order_relaxed), cancel_skipped.load(std::memory_order_relaxed),
+                cancel_running.load(std::memory_order_relaxed), cancel_wasted_ns.load(std::memory_order_relaxed)};
+    }
+
+    // Продолжение: fn получает результат parent. Подробности в add_task_after
+    size_t then(size_t parent_id, std::function<T(T)> fn, Priority priority = Priority::Normal) {
+        return add_task_after({parent_id}, [fn = std::move(fn)](const std::vector<T>& in) { return fn(in[0]); },
+                              priority);
+    }
+
+    // Задача графа: станет готовой, когда завершатся все deps, и получит их результаты по порядку.
+    // Запускается на воркере, который завершил последнюю зависимость, через его локальную
+    // очередь, минуя общую: данные зависимостей еще горячие в его кэше.
+    // Результаты deps при этом остаются доступными клиенту через request_result.
+    // Узлы в ожидании не занимают место в ограниченной очереди
+    size_t add_task_after(const std::vector<size_t>& deps, std::function<T(const std::vector<T>&)> fn,
+                          Priority priority = Priority::Normal) {
+        auto node = std::make_shared<GraphNode>();
+        node->id = task_counter++;
+        node->priority = priority;
+        {
+            std::lock_guard<std::mutex> lock(result_mutex);
+            for (size_t dep : deps) {
+                auto it = results.find(dep);
+                if (it == results.end())
+                    throw std::runtime_error("Task ID not found!");
+                node->inputs.push_back(it->second);
+            }
+        }
+        node->task = std::packaged_task<T()>([inputs = node->inputs, fn = std::move(fn)] {
+            std::vector<T> values;
+            values.reserve(inputs.size());
+            for (const auto& input : inputs)
+                values.push_back(input.get());
+            return fn(values);
+        });
+        {
+            std::lock_guard<std::mutex> lock(result_mutex);
+            results[node->id] = node->task.get_future();
+        }
+
+        // Пара с барьером в notify_dependents: либо мы увидим зависимость готовой,
+        // либо воркер увидит graph_waiting > 0 и заберет узел
+        graph_waiting.fetch_add(1, std::memory_order_seq_cst);
+        size_t remaining = 0;
+        {
+            std::lock_guard<std::mutex> lock(graph_mutex);
+            for (size_t k = 0; k < deps.size(); ++k) {
+                if (node->inputs[k].wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+                    continue;
+                waiters[deps[k]].push_back(node);
+                ++remaining;
+            }
+            node->remaining = remaining;
+            graph_waiting.fetch_add(remaining, std::memory_order_relaxed);
+        }
+        graph_waiting.fetch_sub(1, std::memory_order_relaxed);
+
+        if (remaining == 0)
+            throw_on_error(enqueue(make_graph_job(*node), true));
+        return node->id;
+    }
+
+    // Клиенту результат не нужен, но задача выполнится (например, ради зависимых задач графа)
+    void release(size_t task_id) {
+        std::lock_guard<std::mutex> lock(result_mutex);
+        results.erase(task_id);
+    }
+
+    size_t add_pure_task(uint32_t fn_id, T x, T y = T{}) {
+        if (fn_id < OP_COUNT)
+            return add_op(static_cast<Op>(fn_id), x, y);
+
+        const auto& fn = pure_funcs.at(fn_id - OP_COUNT);
+        if (!memo)
+            return add_task([&fn, x, y] { return fn(x, y); });
+
+        MemoKey<T> key = make_key(fn_id, x, y);
+        T cached;
+        if (memo->lookup(key, cached))
+            return add_ready(cached);
+        return add_task([this, &fn, key, x, y] {
+            T value = fn(x, y);
+            memo->insert(key, value);
+            return value;
+        });
+    }
+
+
+    double request_result(size_t task_id) {
+        std::shared_future<T> result;
+        {
+            // Ждем вне блокировки, иначе один клиент держит result_mutex и тормозит add_task остальных
+            std::lock_guard<std::mutex> lock(result_mutex);
+            auto it = results.find(task_id);
+
+            if (it == results.end()) {
+                throw std::runtime_error("Task ID not found!");
+            }
+            result = std::move(it->second);
+            results.erase(it);
+        }
+        return result.get();
+    }
+
+    // Ждет не дольше timeout. При Timeout результат можно запросить повторно
+    ResultStatus request_result(size_t task_id, Clock::duration timeout, T& value) {
+        std::shared_future<T> result;
+        {
+            std::lock_guard<std::mutex> lock(result_mutex);
+            auto it = results.find(task_id);
+
+            if (it == results.end()) {
+                throw std::runtime_error("Task ID not found!");
+            }
+            result = std::move(it->second);
+            results.erase(it);
+        }
+        if (result.wait_for(timeout) == std::future_status::timeout) {
+            std::lock_guard<std::mutex> lock(result_mutex);
+            results[task_id] = std::move(result);
+            return ResultStatus::Timeout;
+        }
+        try {
+            value = result.get();
+        } catch (const std::future_error& e) {
+            if (e.code() != std::future_errc::broken_promise) throw;
+            return ResultStatus::Cancelled;
+        }
+        return ResultStatus::Ready;
+    }
+
+    // Задержка от постановки в очередь до завершения, по классам приоритета
+    LatencySummary latency(Priority priority) const {
+        const LatencyHistogram& hist = latency_hist[static_cast<size_t>(priority)];
+        return {hist.count(), hist.percentile(0.5), hist.percentile(0.99), hist.percentile(0.999)};
+    }
+
+    size_t deadline_misses() const { return deadline_miss_count.load(std::memory_order_relaxed); }
+
+    // Замеры очереди и выполнения по воркерам. Отключаются для оценки накладных расходов,
+    // вызывать до start()
+    void enable_stats(bool enabled) { stats_enabled = enabled; }
+
+    // Отдельная очередь на каждый поток-производитель для задач класса Normal.
+    // При ShedLowest с ограниченной емкостью не используется. Вызывать до start()
+    void enable_sharding(bool enabled) { sharding = enabled; }
+
+    void set_idle_policy(IdlePolicy idle_policy) { idle = idle_policy; }
+
+    // Вызывается воркером для каждого посчитанного пакета типизированных запросов до того,
+    // как клиенты получат результаты. Для проверки на лету; вызывать до start()
+    using ResultTap = std::function<void(Op op, const T* x, const T* y, const T* result, size_t n)>;
+    void set_result_tap(ResultTap tap) { result_tap = std::move(tap); }
+
+    // Число активных воркеров меняется от min до nworkers раз в period: добавляем, если
+    // очередь растет или активные заняты больше чем на 85%, убираем при пустой очереди и
+    // загрузке ниже 30%. Загрузка считается по busy_ns, так что нужна включенная статистика.
+    // Лишние воркеры не завершаются, а спят до следующего увеличения. Вызывать до start()
+    void enable_autoscale(size_t min, std::chrono::milliseconds period) {
+        min_workers = std::clamp<size_t>(min, 1, nworkers);
+        scale_period = period;
+        active_workers.store(min_workers, std::memory_order_relaxed);
+    }
+
+    size_t active_worker_count() const { return active_workers.load(std::memory_order_relaxed); }
+    size_t scale_ups() const { return scale_up_count.load(std::memory_order_relaxed); }
+    size_t scale_downs() const { return scale_down_count.load(std::memory_order_relaxed); }
+
+    ServerStats stats() const {
+        ServerStats out{};
+        for (size_t i = 0; i < nworkers; ++i) {
+            const WorkerStats& w = worker_stats[i];
+            WorkerSnapshot snap{};
+            snap.tasks = w.tasks.load(std::memory_order_relaxed);
+            snap.batches = w.batches.load(std::memory_order_relaxed);
+            snap.busy_ns = w.busy_ns.load(std::memory_order_relaxed);
+            snap.queue = summarize(w.queue_time);
+            snap.exec = summarize(w.exec_time);
+            out.tasks += snap.tasks;
+            out.workers.push_back(snap);
+        }
+        out.queue_depth = queue_depth();
+        out.rejected = rejected();
+        out.shed = shed();
+        out.deadline_misses = deadline_misses();
+        out.uptime_s = std::chrono::duration<double>(Clock::now() - started).count();
+        return out;
+    }
+
+    void print_stats(std::ostream& out) const {
+        ServerStats st = stats();
+        out << "uptime " << st.uptime_s << " s, tasks " << st.tasks << ", depth " << st.queue_depth
+            << ", rejected " << st.rejected << ", shed " << st.shed << "\n";
+        for (size_t i = 0; i < st.workers.size(); ++i) {
+            const WorkerSnapshot& w = st.workers[i];
+            out << "  worker " << i << ": tasks " << w.tasks << ", batches " << w.batches
+                << ", util " << 100.0 * w.busy_ns / 1e9 / st.uptime_s << "%"
+                << ", queue p50/p99 " << w.queue.p50_ns / 1000.0 << "/" << w.queue.p99_ns / 1000.0 << "us"
+                << ", exec p50/p99 " << w.exec.p50_ns / 1000.0 << "/" << w.exec.p99_ns / 1000.0 << "us\n";
+        }
+    }
+
+    // Печатает print_stats раз в period, пока сервер не остановлен
+    void start_stats_dump(std::chrono::milliseconds period, std::ostream& out) {
+        stats_thread = std::jthread([this, period, &out](std::stop_token stoken) {
+            std::mutex m;
+            std::condition_variable_any cv;
+            std::unique_lock<std::mutex> lock(m);
+            while (true) {
+                cv.wait_for(lock, stoken, period, [] { return false; });
+                if (stoken.stop_requested()) break;
+                print_stats(out);
+            }
+        });
+    }
+
+    size_t queue_depth() const { return queued.load(std::memory_order_relaxed); }
+    size_t peak_queue_depth() const { return peak_queued.load(std::memory_order_relaxed); }
+    size_t rejected() const { return rejected_count.load(std::memory_order_relaxed); }
+    size_t shed() const { return shed_count.load(std::memory_order_relaxed); }
+
+    void print_latency_stats(std::ostream& out) const {
+        for (size_t k = 0; k < PRIORITY_COUNT; ++k) {
+            LatencySummary s = latency(static_cast<Priority>(k));
+            if (s.count == 0) continue;
+            out << priority_name(static_cast<Priority>(k)) << ": n=" << s.count
+                << " p50=" << s.p50_ns / 1000.0 << "us p99=" << s.p99_ns / 1000.0
+                << "us p999=" << s.p999_ns / 1000.0 << "us\n";
+        }
+        out << "deadline misses: " << deadline_misses() << "\n";
+    }
+
+private:
+    size_t nworkers;
+    size_t capacity;
+    OverflowPolicy policy;
+    std::vector<std::jthread> workers;
+    std::queue<Job<T>> tasks;                 // Normal, FIFO
+    std::vector<Job<T>> urgent;               // High, куча по дедлайну
+    std::queue<Job<T>> background;            // Low
+    std::deque<OpRequest<T>> op_tasks[OP_COUNT];
+    // shared_future, чтобы результат мог одновременно ждать клиент и зависимые задачи графа
+    std::unordered_map<size_t, std::shared_future<T>> results;
+
+    std::mutex queue_mutex, result_mutex;
+    std::stop_source stop_src;
+    std::condition_variable cond_var;
+    std::condition_variable space_cv;
+    std::atomic<size_t> task_counter{0};
+
+    std::unique_ptr<MemoCache<T>> memo;
+    // deque: register_pure не сдвигает уже зарегистрированные функции, на них ссылаются задачи в очереди
+    std::deque<std::function<T(T, T)>> pure_funcs;
+
+    LatencyHistogram latency_hist[PRIORITY_COUNT];
+    std::atomic<size_t> deadline_miss_count{0};
+
+    // queued меняется и без queue_mutex (очереди производителей), поэтому место в очереди
+    // резервируется только через try_reserve: проверка емкости и увеличение - одна операция
+    std::atomic<size_t> queued{0}, peak_queued{0};
+    std::atomic<size_t> rejected_count{0}, shed_count{0};
+
+    // Очередь одного производителя: пишет только он, разбирает тот воркер, который захватил
+    // флаг draining. Переполнение - не ошибка: задача уходит в общую очередь
+    struct ProducerQueue {
+        static constexpr size_t CAPACITY = 1024;
+
+        std::unique_ptr<Job<T>[]> slots = std::make_unique<Job<T>[]>(CAPACITY);
+        std::thread::id owner;
+        alignas(64) std::atomic<size_t> head{0};
+        alignas(64) std::atomic<size_t> tail{0};
+        alignas(64) std::atomic_flag draining;
+
+        bool try_push(Job<T>& job) {
+            size_t h = head.load(std::memory_order_relaxed);
+            if (h - tail.load(std::memory_order_acquire) == CAPACITY)
+                return false;
+            slots[h % CAPACITY] = std::move(job);
+            head.store(h + 1, std::memory_order_release);
+            return true;
+        }
+
+        size_t pop_batch(std::vector<Job<T>>& out, size_t max_count) {
+            size_t t = tail.load(std::memory_order_relaxed);
+            size_t count = std::min(head.load(std::memory_order_acquire) - t, max_count);
+            for (size_t i = 0; i < count; ++i)
+                out.push_back(std::move(slots[(t + i) % CAPACITY]));
+            tail.store(t + count, std::memory_order_release);
+            return count;
+        }
+
+        bool empty() const {
+            return head.load(std::memory_order_acquire) == tail.load(std::memory_order_acquire);
+        }
+    };
+
+    static constexpr size_t MAX_PRODUCERS = 64;
+
+    static uint64_t next_instance_id() {
+        static std::atomic<uint64_t> counter{0};
+        return ++counter;
+    }
+
+    // Пишет только свой воркер, поэтому гистограммы и счетчики обновляются без RMW
+    struct WorkerStats {
+        LatencyHistogram queue_time;
+        LatencyHistogram exec_time;
+        std::atomic<uint64_t> tasks{0};
+        std::atomic<uint64_t> batches{0};
+        std::atomic<uint64_t> busy_ns{0};
+    };
+
+    // Отмененные, но еще не снятые с очереди id. cancelled_pending дублирует размер множества,
+    // чтобы воркеры без отмен не брали cancel_mutex
+    std::mutex cancel_mutex;
+    std::unordered_set<size_t> cancelled;
+    std::unordered_map<size_t, std::stop_source> stop_sources;
+    std::atomic<size_t> cancelled_pending{0};
+    std::atomic<uint64_t> cancel_requested{0}, cancel_skipped{0}, cancel_running{0}, cancel_wasted_ns{0};
+
+    static bool is_ready(const std::shared_future<T>& result) {
+        return result.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+    }
+
+    // Снимает отметку об отмене; true, если задача была отменена
+    bool take_cancelled(size_t task_id) {
+        if (cancelled_pending.load(std::memory_order_acquire) == 0)
+            return false;
+        std::lock_guard<std::mutex> lock(cancel_mutex);
+        if (cancelled.erase(task_id) == 0)
+            return false;
+        cancelled_pending.store(cancelled.size(), std::memory_order_release);
+        return true;
+    }
+
+    void forget_stop_source(size_t task_id) {
+        std::lock_guard<std::mutex> lock(cancel_mutex);
+        stop_sources.erase(task_id);
+    }
+
+    struct GraphNode {
+        size_t id;
+        Priority priority;
+        std::vector<std::shared_future<T>> inputs;
+        std::packaged_task<T()> task;
+        size_t remaining = 0;
+    };
+
+    // Ожидающие узлы по id зависимости. graph_waiting - число таких ожиданий,
+    // чтобы без графа воркеры не брали graph_mutex
+    std::mutex graph_mutex;
+    std::unordered_map<size_t, std::vector<std::shared_ptr<GraphNode>>> waiters;
+    std::atomic<size_t> graph_waiting{0};
+
+    Job<T> make_graph_job(GraphNode& node) {
+        Job<T> job;
+        job.id = node.id;
+        job.task = std::move(node.task);
+        job.priority = node.priority;
+        job.submitted = Clock::now();
+        return job;
+    }
+
+    // Вызывается после завершения (или выбрасывания) задачи task_id.
+    // Возвращает узлы, у которых это была последняя зависимость
+    void notify_dependents(size_t task_id, std::vector<Job<T>>& runnable) {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (graph_waiting.load(std::memory_order_relaxed) == 0)
+            return;
+        std::lock_guard<std::mutex> lock(graph_mutex);
+        auto it = waiters.find(task_id);
+        if (it == waiters.end())
+            return;
+        for (auto& node : it->second) {
+            graph_waiting.fetch_sub(1, std::memory_order_relaxed);
+            if (--node->remaining == 0)
+                runnable.push_back(make_graph_job(*node));
+        }
+        waiters.erase(it);
+    }
+
+    // Очереди производителей. Живут до уничтожения сервера, shards - их копия для чтения
+    // воркерами без registry_mutex
+    uint64_t instance_id = next_instance_id();
+    bool sharding = true;
+    std::mutex registry_mutex;
+    std::vector<std::unique_ptr<ProducerQueue>> producers;
+    std::array<std::atomic<ProducerQueue*>, MAX_PRODUCERS> shards{};
+    std::atomic<size_t> shard_count{0};
+    std::atomic<size_t> sleeping_workers{0};
+    std::atomic<size_t> urgent_pending{0};
+
+    IdlePolicy idle = IdlePolicy::for_this_machine();
+    ResultTap result_tap;
+    std::atomic<size_t> active_workers;
+    size_t min_workers = std::numeric_limits<size_t>::max();
+    std::chrono::milliseconds scale_period{10};
+    std::condition_variable scale_cv;        // воркеры сверх active_workers, под queue_mutex
+    std::jthread scaler_thread;
+    std::atomic<size_t> scale_up_count{0};
+    std::atomic<size_t> scale_down_count{0};
+
+    std::unique_ptr<WorkerStats[]> worker_stats;
+    bool stats_enabled = true;
+    Clock::time_point started;
+    std::jthread stats_thread;
+
+    static LatencySummary summarize(const LatencyHistogram& hist) {
+        return {hist.count(), hist.percentile(0.5), hist.percentile(0.99), hist.percentile(0.999)};
+    }
+
+    static uint64_t ns_between(Clock::time_point from, Clock::time_point to) {
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(to - from).count());
+    }
+
+    static void bump(std::atomic<uint64_t>& counter, uint64_t delta) {
+        counter.store(counter.load(std::memory_order_relaxed) + delta, std::memory_order_relaxed);
+    }
+
+    void record_work(WorkerStats& w, Clock::time_point submitted, Clock::time_point dequeued,
+                     uint64_t exec_ns) {
+        w.queue_time.record_single_writer(ns_between(submitted, dequeued));
+        w.exec_time.record_single_writer(exec_ns);
+    }
+
+    Job<T> make_job(std::packaged_task<T()> task, Priority priority,
+                    std::optional<Clock::duration> deadline) {
+        Job<T> job;
+        job.id = task_counter++;
+        job.task = std::move(task);
+        job.priority = priority;
+        job.submitted = Clock::now();
+        if (deadline)
+            job.deadline = job.submitted + *deadline;
+        return job;
+    }
+
+    static void throw_on_error(SubmitStatus status) {
+        if (status == SubmitStatus::QueueFull)
+            throw std::runtime_error("Task queue is full!");
+        if (status == SubmitStatus::Stopped)
+            throw std::runtime_error("Server is stopped!");
+    }
+
+    SubmitStatus submit_job(std::function<T()> task, Priority priority,
+                            std::optional<Clock::duration> deadline, bool may_block, size_t& task_id) {
+        Job<T> job = make_job(std::packaged_task<T()>(std::move(task)), priority, deadline);
+        std::future<T> result = job.task.get_future();
+        task_id = job.id;
+        SubmitStatus status = enqueue(std::move(job), may_block);
+        if (status == SubmitStatus::Ok) {
+            // Отклоненные задачи в results не попадают, так что карта не растет под перегрузкой
+            std::lock_guard<std::mutex> lock(result_mutex);
+            results[task_id] = std::move(result);
+        }
+        return status;
+    }
+
+    // Вызывается под queue_mutex. Резервирует место (Ok), ждет его, вытесняет задачу или
+    // отказывает по policy. Вытесненные задачи попадают в victims: их callback вызывается
+    // после снятия блокировки
+    SubmitStatus admit(std::unique_lock<std::mutex>& lock, Priority priority, bool may_block,
+                       std::vector<Job<T>>& victims) {
+        while (!try_reserve()) {
+            if (stop_src.stop_requested())
+                return SubmitStatus::Stopped;
+            // Освободившееся место может успеть занять очередь производителя: тогда вытесняем снова
+            if (policy == OverflowPolicy::ShedLowest && shed_lower(priority, victims))
+                continue;
+            if (policy != OverflowPolicy::Block || !may_block) {
+                rejected_count.fetch_add(1, std::memory_order_relaxed);
+                return SubmitStatus::QueueFull;
+            }
+            space_cv.wait(lock);
+        }
+        if (stop_src.stop_requested()) {
+            queued.fetch_sub(1, std::memory_order_relaxed);
+            return SubmitStatus::Stopped;
+        }
+        return SubmitStatus::Ok;
+    }
+
+    // Выбрасывает старейшую задачу самого низкого класса ниже priority. Ее future получит
+    // broken_promise, клиент увидит исключение в request_result; задаче с callback его
+    // передаст abandon_all
+    bool shed_lower(Priority priority, std::vector<Job<T>>& out) {
+        std::queue<Job<T>>* victims[] = {&background, &tasks};
+        Priority classes[] = {Priority::Low, Priority::Normal};
+        for (size_t k = 0; k < 2; ++k) {
+            if (classes[k] <= priority || victims[k]->empty()) continue;
+            size_t victim_id = victims[k]->front().id;
+            out.push_back(std::move(victims[k]->front()));
+            victims[k]->pop();
+            queued.fetch_sub(1, std::memory_order_relaxed);
+            shed_count.fetch_add(1, std::memory_order_relaxed);
+            // Зависимые узлы все равно запускаем: они получат broken_promise на входе
+            std::vector<Job<T>> runnable;
+            notify_dependents(victim_id, runnable);
+            for (auto& job : runnable) {
+                note_enqueued();
+                push_locked(std::move(job));
+            }
+            return true;
+        }
+        return false;
+    }
+
+    // Задача не будет выполнена: освобождает ее stop_source и сообщает callback-клиенту.
+    // Вызывается без queue_mutex: callback может сразу поставить новую задачу
+    void abandon(Job<T>& job) {
+        take_cancelled(job.id);
+        if (job.cancellable)
+            forget_stop_source(job.id);
+        job.task = {};
+        if (job.on_abandon)
+            job.on_abandon(std::make_exception_ptr(std::future_error(std::future_errc::broken_promise)));
+    }
+
+    void abandon_all(std::vector<Job<T>>& victims) {
+        for (auto& job : victims)
+            abandon(job);
+        victims.clear();
+    }
+
+    // Занимает место в очереди, если queued < capacity
+    bool try_reserve() {
+        size_t depth = queued.fetch_add(1, std::memory_order_relaxed) + 1;
+        if (depth > capacity) {
+            queued.fetch_sub(1, std::memory_order_relaxed);
+            return false;
+        }
+        note_peak(depth);
+        return true;
+    }
+
+    // Без проверки емкости: зависимые задачи вытесненной
+    void note_enqueued() {
+        note_peak(queued.fetch_add(1, std::memory_order_relaxed) + 1);
+    }
+
+    void note_peak(size_t depth) {
+        size_t peak = peak_queued.load(std::memory_order_relaxed);
+        while (depth > peak && !peak_queued.compare_exchange_weak(peak, depth, std::memory_order_relaxed)) {
+        }
+    }
+
+    void note_dequeued(size_t count) {
+        queued.fetch_sub(count, std::memory_order_relaxed);
+        if (capacity != std::numeric_limits<size_t>::max())
+            space_cv.notify_all();
+    }
+
+    // Из очереди производителя задачу не вытеснить, поэтому при ShedLowest с ограниченной
+    // очередью Normal идет в общую очередь, где ее может выбросить High
+    bool may_shard(const Job<T>& job) const {
+        if (job.priority != Priority::Normal || !sharding)
+            return false;
+        return policy != OverflowPolicy::ShedLowest || capacity == std::numeric_limits<size_t>::max();
+    }
+
+    SubmitStatus enqueue(Job<T> job, bool may_block) {
+        if (may_shard(job) && enqueue_sharded(job))
+            return SubmitStatus::Ok;
+        std::vector<Job<T>> victims;
+        {
+            std::unique_lock<std::mutex> lock(queue_mutex);
+            SubmitStatus status = admit(lock, job.priority, may_block, victims);
+            if (status != SubmitStatus::Ok) {
+                lock.unlock();
+                abandon_all(victims);
+                return status;
+            }
+            push_locked(std::move(job));
+        }
+        abandon_all(victims);
+        cond_var.notify_one();
+        return SubmitStatus::Ok;
+    }
+
+    // Вызывается под queue_mutex
+    void push_locked(Job<T> job) {
+        switch (job.priority) {
+            case Priority::High:
+                urgent.push_back(std::move(job));
+                std::push_heap(urgent.begin(), urgent.end(), LaterDeadline{});
+                urgent_pending.store(urgent.size(), std::memory_order_relaxed);
+                break;
+            case Priority::Low:
+                background.push(std::move(job));
+                break;
+            default:
+                tasks.push(std::move(job));
+        }
+    }
+
+    // Очередь текущего потока для этого сервера; регистрируется при первом обращении.
+    // nullptr, если производителей больше MAX_PRODUCERS
+    ProducerQueue* producer_queue() {
+        struct Cache {
+            uint64_t server_id = 0;
+            ProducerQueue* queue = nullptr;
+        };
+        thread_local Cache cache;
+        if (cache.server_id == instance_id)
+            return cache.queue;
+
+        std::lock_guard<std::mutex> lock(registry_mutex);
+        std::thread::id self = std::this_thread::get_id();
+        ProducerQueue* queue = nullptr;
+        for (auto& q : producers) {
+            if (q->owner == self) queue = q.get();
+        }
+        if (!queue && producers.size() < MAX_PRODUCERS) {
+            producers.push_back(std::make_unique<ProducerQueue>());
+            queue = producers.back().get();
+            queue->owner = self;
+            shards[producers.size() - 1].store(queue, std::memory_order_relaxed);
+            shard_count.store(producers.size(), std::memory_order_release);
+        }
+        cache = {instance_id, queue};
+        return queue;
+    }
+
+    bool enqueue_sharded(Job<T>& job) {
+        ProducerQueue* queue = producer_queue();
+        if (!queue)
+            return false;
+        // Место в ограниченной очереди резервируем атомарно; если его нет, пусть
+        // решает общий путь с admit и политикой переполнения
+        if (!try_reserve())
+            return false;
+        if (!queue->try_push(job)) {
+            queued.fetch_sub(1, std::memory_order_relaxed);
+            return false;
+        }
+
+        // Пара с sleeping_workers в server_loop: либо воркер увидит задачу в предикате,
+        // либо мы увидим, что он спит, и разбудим его под queue_mutex
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (sleeping_workers.load(std::memory_order_relaxed) > 0) {
+            { std::lock_guard<std::mutex> lock(queue_mutex); }
+            cond_var.notify_one();
+        }
+        return true;
+    }
+
+    // Забирает пакет из очередей производителей, обходя их по кругу
+    bool drain_shards(std::vector<Job<T>>& out, size_t& next_shard) {
+        size_t count = shard_count.load(std::memory_order_acquire);
+        for (size_t k = 0; k < count; ++k) {
+            ProducerQueue* queue = shards[(next_shard + k) % count].load(std::memory_order_relaxed);
+            if (queue->empty() || queue->draining.test_and_set(std::memory_order_acquire))
+                continue;
+            queue->pop_batch(out, BATCH_SIZE);
+            queue->draining.clear(std::memory_order_release);
+            next_shard = (next_shard + k + 1) % count;
+            if (!out.empty())
+                return true;
+        }
+        return false;
+    }
+
+    bool has_shard_work() const {
+        size_t count = shard_count.load(std::memory_order_acquire);
+        for (size_t k = 0; k < count; ++k)
+            if (!shards[k].load(std::memory_order_relaxed)->empty())
+                return true;
+        return false;
+    }
+
+    bool is_standby(size_t worker_id) const {
+        return worker_id >= active_workers.load(std::memory_order_relaxed);
+    }
+
+    // Ждем работу без блокировок, прежде чем засыпать на cond_var
+    void idle_wait(const std::stop_token& stoken, size_t worker_id) const {
+        auto ready = [&] {
+            return queued.load(std::memory_order_acquire) > 0 || stoken.stop_requested() || is_standby(worker_id);
+        };
+        for (uint32_t i = 0; i < idle.spin; ++i) {
+            if (ready()) return;
+            cpu_relax();
+        }
+        for (uint32_t i = 0; i < idle.yields; ++i) {
+            if (ready()) return;
+            std::this_thread::yield();
+        }
+    }
+
+    // Отключенный воркер спит, пока его снова не включат. Если он успел перехватить
+    // уведомление о новой задаче, передаем его дальше
+    void park_standby(const std::stop_token& stoken, size_t worker_id) {
+        std::unique_lock<std::mutex> lock(queue_mutex);
+        if (has_work() || has_shard_work())
+            cond_var.notify_one();
+        scale_cv.wait(lock, [&] { return !is_standby(worker_id) || stoken.stop_requested(); });
+    }
+
+    void scaler_loop(std::stop_token stoken) {
+        std::mutex m;
+        std::condition_variable_any cv;
+        std::unique_lock<std::mutex> lock(m);
+        uint64_t last_busy = 0;
+        auto last = Clock::now();
+        while (true) {
+            cv.wait_for(lock, stoken, scale_period, [] { return false; });
+            if (stoken.stop_requested()) break;
+
+            uint64_t busy = 0;
+            for (size_t i = 0; i < nworkers; ++i)
+                busy += worker_stats[i].busy_ns.load(std::memory_order_relaxed);
+            auto now = Clock::now();
+            size_t active = active_workers.load(std::memory_order_relaxed);
+            double utilization = double(busy - last_busy) / (double(ns_between(last, now)) * active);
+            last_busy = busy;
+            last = now;
+
+            size_t depth = queue_depth();
+            if (active < nworkers && (depth > active || utilization > 0.85)) {
+                {
+                    std::lock_guard<std::mutex> guard(queue_mutex);
+                    active_workers.store(active + 1, std::memory_order_relaxed);
+                }
+                scale_cv.notify_all();
+                scale_up_count.fetch_add(1, std::memory_order_relaxed);
+            } else if (active > min_workers && depth == 0 && utilization < 0.3) {
+                {
+                    std::lock_guard<std::mutex> guard(queue_mutex);
+                    active_workers.store(active - 1, std::memory_order_relaxed);
+                }
+                // Спящий на cond_var воркер сам уйдет в резерв
+                cond_var.notify_all();
+                scale_down_count.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+    }
+
+    bool has_work() const {
+        return !urgent.empty() || !tasks.empty() || has_ops() || !background.empty();
+    }
+
+    void record_latency(Priority priority, Clock::time_point submitted, Clock::time_point done) {
+        auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(done - submitted).count();
+        latency_hist[static_cast<size_t>(priority)].record(static_cast<uint64_t>(ns));
+    }
+
+    // Попадание в кэш: результат готов сразу, очередь не трогаем
+    size_t add_ready(T value) {
+        size_t task_id = task_counter++;
+        std::promise<T> promise;
+        promise.set_value(value);
+        std::lock_guard<std::mutex> lock(result_mutex);
+        results[task_id] = promise.get_future();
+        return task_id;
+    }
+
+    bool has_ops() const {
+        for (const auto& q : op_tasks)
+            if (!q.empty()) return true;
+        return false;
+    }
+
+    // Забирает до BATCH_SIZE запросов одного opcode, обходя opcode по кругу.
+    // Вызывается под queue_mutex
+    bool take_op_batch(std::vector<OpRequest<T>>& batch, size_t& next_op) {
+        for (size_t k = 0; k < OP_COUNT; ++k) {
+            auto& q = op_tasks[(next_op + k) % OP_COUNT];
+            if (q.empty()) continue;
+            size_t count = std::min(q.size(), BATCH_SIZE);
+            for (size_t i = 0; i < count; ++i) {
+                batch.push_back(std::move(q.front()));
+                q.pop_front();
+            }
+            next_op = (next_op + k + 1) % OP_COUNT;
+            return true;
+        }
+        return false;
+    }
+
+    void run_op_batch(std::vector<OpRequest<T>>& batch, WorkerStats& w, Clock::time_point dequeued,
+                      std::vector<Job<T>>& runnable) {
+        TRACE_SCOPE("op_batch");
+        if (cancelled_pending.load(std::memory_order_acquire) != 0) {
+            auto last = std::remove_if(batch.begin(), batch.end(),
+                                       [this](const OpRequest<T>& r) { return take_cancelled(r.id); });
+            cancel_skipped.fetch_add(batch.end() - last, std::memory_order_relaxed);
+            for (auto it = last; it != batch.end(); ++it)
+                notify_dependents(it->id, runnable);
+            batch.erase(last, batch.end());
+            if (batch.empty()) return;
+        }
+        T x[BATCH_SIZE], y[BATCH_SIZE], res[BATCH_SIZE];
+        size_t n = batch.size();
+        for (size_t i = 0; i < n; ++i) {
+            x[i] = batch[i].x;
+            y[i] = batch[i].y;
+        }
+        try {
+            eval_batch(batch[0].op, x, y, res, n);
+            if (result_tap)
+                result_tap(batch[0].op, x, y, res, n);
+        } catch (...) {
+            // Исключение не должно уйти из воркера: его получает каждый запрос пакета
+            std::exception_ptr error = std::current_exception();
+            for (size_t i = 0; i < n; ++i) {
+                batch[i].promise.set_exception(error);
+                notify_dependents(batch[i].id, runnable);
+            }
+            return;
+        }
+        Clock::time_point done = Clock::now();
+        if (stats_enabled) {
+            uint64_t exec_ns = ns_between(dequeued, done);
+            for (size_t i = 0; i < n; ++i)
+                record_work(w, batch[i].submitted, dequeued, exec_ns / n);
+            bump(w.tasks, n);
+            bump(w.batches, 1);
+            bump(w.busy_ns, exec_ns);
+        }
+        for (size_t i = 0; i < n; ++i) {
+            record_latency(Priority::Normal, batch[i].submitted, done);
+            if (memo)
+                memo->insert(make_key(static_cast<uint32_t>(batch[i].op), x[i], y[i]), res[i]);
+            batch[i].promise.set_value(res[i]);
+            notify_dependents(batch[i].id, runnable);
+        }
+        std::atomic_thread_fence(std::memory_order_seq_cst);  // парный барьер в cancel()
+        if (cancelled_pending.load(std::memory_order_acquire) != 0) {
+            for (size_t i = 0; i < n; ++i)
+                if (take_cancelled(batch[i].id))
+                    cancel_running.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    void server_loop(std::stop_token stoken, size_t worker_id) {
+        WorkerStats& w = worker_stats[worker_id];
+        std::vector<OpRequest<T>> batch;
+        batch.reserve(BATCH_SIZE);
+        std::vector<Job<T>> shard_batch;
+        shard_batch.reserve(BATCH_SIZE);
+        size_t next_op = 0;
+        size_t next_shard = worker_id;
+        bool prefer_ops = true;
+        bool prefer_shards = true;
+        // Задачи графа, чьи зависимости завершил этот воркер. Трогает только он сам
+        std::deque<Job<T>> local;
+        std::vector<Job<T>> runnable;
+
+        auto run_local = [&](Job<T>& job, Clock::time_point dequeued) {
+            runnable.clear();
+            run_job(job, w, dequeued, runnable);
+            for (auto& next : runnable)
+                local.push_back(std::move(next));
+        };
+
+        while (!stoken.stop_requested()) {
+            if (!local.empty()) {
+                Job<T> job = std::move(local.front());
+                local.pop_front();
+                run_local(job, Clock::now());
+                continue;
+            }
+            if (is_standby(worker_id)) {
+                park_standby(stoken, worker_id);
+                continue;
+            }
+
+            // Очереди производителей разбираем без queue_mutex, пока нет срочных задач.
+            // Чередуем с общей очередью, чтобы та не голодала
+            if (prefer_shards && urgent_pending.load(std::memory_order_relaxed) == 0) {
+                prefer_shards = false;
+                if (drain_shards(shard_batch, next_shard)) {
+                    Clock::time_point dequeued = Clock::now();
+                    note_dequeued(shard_batch.size());
+                    for (auto& job : shard_batch)
+                        run_local(job, dequeued);
+                    shard_batch.clear();
+                    continue;
+                }
+            }
+            prefer_shards = true;
+
+            Job<T> job;
+            batch.clear();
+            if (queued.load(std::memory_order_acquire) == 0)
+                idle_wait(stoken, worker_id);
+            {
+                std::unique_lock<std::mutex> lock(queue_mutex);
+                sleeping_workers.fetch_add(1, std::memory_order_seq_cst);
+                cond_var.wait(lock, [this, &stoken, worker_id] {
+                    return has_work() || has_shard_work() || stoken.stop_requested() || is_standby(worker_id);
+                });
+                sleeping_workers.fetch_sub(1, std::memory_order_relaxed);
+
+                if (stoken.stop_requested()) break;
+                if (!has_work()) {
+                    // Работа только в очередях производителей или воркер отключен. Очередь
+                    // может разбирать другой воркер (флаг draining): уступаем процессор,
+                    // а не крутимся между drain_shards и cond_var
+                    lock.unlock();
+                    std::this_thread::yield();
+                    continue;
+                }
+
+                // Сначала High по EDF, затем Normal (чередуем пакеты типизированных запросов
+                // и замыкания, чтобы никто не голодал), затем Low
+                if (!urgent.empty()) {
+                    std::pop_heap(urgent.begin(), urgent.end(), LaterDeadline{});
+                    job = std::move(urgent.back());
+                    urgent.pop_back();
+                    urgent_pending.store(urgent.size(), std::memory_order_relaxed);
+                } else if ((prefer_ops || tasks.empty()) && take_op_batch(batch, next_op)) {
+                    prefer_ops = false;
+                } else if (!tasks.empty()) {
+                    job = std::move(tasks.front());
+                    tasks.pop();
+                    prefer_ops = true;
+                } else if (!background.empty()) {
+                    job = std::move(background.front());
+                    background.pop();
+                }
+                note_dequeued(batch.empty() ? 1 : batch.size());
+            }
+            // Одна метка времени на извлечение, вторая - на завершение
+            Clock::time_point dequeued = Clock::now();
+            if (!batch.empty()) {
+                runnable.clear();
+                run_op_batch(batch, w, dequeued, runnable);
+                for (auto& next : runnable)
+                    local.push_back(std::move(next));
+                continue;
+            }
+            run_local(job, dequeued);
+        }
+    }
+
+    void run_job(Job<T>& job, WorkerStats& w, Clock::time_point dequeued, std::vector<Job<T>>& runnable) {
+        if (take_cancelled(job.id)) {
+            // Задача уничтожается без запуска, future получит broken_promise
+            cancel_skipped.fetch_add(1, std::memory_order_relaxed);
+            abandon(job);
+            notify_dependents(job.id, runnable);
+            return;
+        }
+        try {
+            TRACE_SCOPE("task");
+            job.task();
+        } catch (const std::exception& e) {
+            std::cerr << "Task execution failed: " << e.what() << '\n';
+            // Зависимые задачи все равно отпускаем, иначе они ждут вечно
+            if (job.cancellable)
+                forget_stop_source(job.id);
+            notify_dependents(job.id, runnable);
+            return;
+        }
+        Clock::time_point done = Clock::now();
+        if (job.cancellable)
+            forget_stop_source(job.id);
+        std::atomic_thread_fence(std::memory_order_seq_cst);  // парный барьер в cancel()
+        if (take_cancelled(job.id)) {
+            cancel_running.fetch_add(1, std::memory_order_relaxed);
+            cancel_wasted_ns.fetch_add(ns_between(dequeued, done), std::memory_order_relaxed);
+        }
+        if (stats_enabled) {
+            uint64_t exec_ns = ns_between(dequeued, done);
+            record_work(w, job.submitted, dequeued, exec_ns);
+            bump(w.tasks, 1);
+            bump(w.busy_ns, exec_ns);
+        }
+        record_latency(job.priority, job.submitted, done);
+        if (done > job.deadline)
+            deadline_miss_count.fetch_add(1, std::memory_order_relaxed);
+
+        notify_dependents(job.id, runnable);
+    }
+};
+
+
+template<typename T>
+class SubmitAwaiter {
+public:
+    SubmitAwaiter(Server<T>& server, std::function<T()> task, Scheduler* executor)
+        : server(server), task(std::move(task)), executor(executor) {}
+
+    bool await_ready() const noexcept { return false; }
+
+    void await_suspend(std::coroutine_handle<> handle) {
+        server.add_task(std::move(task), [this, handle](T value, std::exception_ptr err) {
+            result = value;
+            error = err;
+            if (executor)
+                executor->post(handle);
+            else
+                handle.resume();
+        });
+    }
+
+    T await_resume() {
+        if (error)
+            std::rethrow_exception(error);
+        return result;
+    }
+
+private:
+    Server<T>& server;
+    std::function<T()> task;
+    Scheduler* executor;
+    T result{};
+    std::exception_ptr error;
+};
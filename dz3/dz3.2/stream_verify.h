@@ -0,0 +1,152 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "result_text.h"
+#include "ulp_verify.h"
+
+// Проверка результатов по мере их появления. StreamVerifier принимает текст произвольными
+// кусками (из канала, из дописываемого файла) или готовые строки и останавливается на первой
+// ошибке. В памяти держится только недописанный хвост строки, не длиннее MAX_LINE.
+
+class StreamVerifier {
+public:
+    static constexpr size_t MAX_LINE = 4096;
+
+    explicit StreamVerifier(TolerancePolicy policy) : engine(std::move(policy)) {}
+
+    // false - найдена ошибка, дальше можно не читать
+    bool feed(const char* data, size_t size) {
+        const char* end = data + size;
+        while (data < end && !failed()) {
+            const char* newline = static_cast<const char*>(std::memchr(data, '\n', end - data));
+            if (!newline) {
+                if (partial.size() + (end - data) > MAX_LINE)
+                    return fail("Line too long");
+                partial.append(data, end);
+                break;
+            }
+            if (partial.empty()) {
+                check_line(data, newline + 1);
+            } else {
+                partial.append(data, newline + 1);
+                check_line(partial.data(), partial.data() + partial.size());
+                partial.clear();
+            }
+            data = newline + 1;
+        }
+        return !failed();
+    }
+
+    // Последняя строка без перевода строки
+    bool finish() {
+        if (!partial.empty() && !failed()) {
+            check_line(partial.data(), partial.data() + partial.size());
+            partial.clear();
+        }
+        return !failed();
+    }
+
+    bool check(const ResultRow& row) {
+        ++line_count;
+        if (!engine.add(row.operation, row.arg1, row.arg2, row.result)) {
+            fail(std::string(result_op_name(row.operation)) + " " + std::to_string(row.arg1) + " "
+                 + std::to_string(row.arg2) + " = " + std::to_string(row.result) + ", "
+                 + std::to_string(ulp_error(row.result, reference_value(row.operation, row.arg1, row.arg2)))
+                 + " ulp");
+        }
+        return !failed();
+    }
+
+    size_t lines() const { return line_count; }
+    bool failed() const { return !failure_text.empty(); }
+    // Номер строки (с единицы) и описание первой ошибки
+    size_t failure_line() const { return failure_at; }
+    const std::string& failure() const { return failure_text; }
+    std::chrono::steady_clock::time_point failure_time() const { return failed_at; }
+    const UlpVerifier& stats() const { return engine; }
+
+private:
+    void check_line(const char* begin, const char* end) {
+        ResultRow row;
+        try {
+            parse_result_line(begin, end, row);
+        } catch (const std::exception& e) {
+            ++line_count;
+            fail(e.what());
+            return;
+        }
+        if (!check(row))
+            failure_text = std::string(begin, end[-1] == '\n' ? end - 1 : end);
+    }
+
+    bool fail(std::string text) {
+        failure_at = line_count;
+        failure_text = std::move(text);
+        failed_at = std::chrono::steady_clock::now();
+        return false;
+    }
+
+    UlpVerifier engine;
+    std::string partial;
+    size_t line_count = 0;
+    size_t failure_at = 0;
+    std::string failure_text;
+    std::chrono::steady_clock::time_point failed_at;
+};
+
+// Ограниченный канал строк результатов из потоков сервера в поток проверки.
+// Если проверка отстает, производители ждут: память не растет с длиной прогона
+class VerifyChannel {
+public:
+    explicit VerifyChannel(size_t capacity = 1 << 16) : ring(capacity) {}
+
+    void push(const ResultRow* rows, size_t n) {
+        std::unique_lock<std::mutex> lock(mutex);
+        for (size_t i = 0; i < n; ++i) {
+            not_full.wait(lock, [this] { return count < ring.size() || closed; });
+            if (closed) return;
+            ring[(head + count) % ring.size()] = rows[i];
+            ++count;
+        }
+        not_empty.notify_one();
+    }
+
+    // Забирает накопившиеся строки; false, если канал закрыт и пуст
+    bool pop(std::vector<ResultRow>& out, size_t max_rows) {
+        std::unique_lock<std::mutex> lock(mutex);
+        not_empty.wait(lock, [this] { return count > 0 || closed; });
+        if (count == 0) return false;
+        size_t n = std::min(count, max_rows);
+        for (size_t i = 0; i < n; ++i)
+            out.push_back(ring[(head + i) % ring.size()]);
+        head = (head + n) % ring.size();
+        count -= n;
+        not_full.notify_all();
+        return true;
+    }
+
+    void close() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            closed = true;
+        }
+        not_empty.notify_all();
+        not_full.notify_all();
+    }
+
+private:
+    std::vector<ResultRow> ring;
+    size_t head = 0;
+    size_t count = 0;
+    bool closed = false;
+    std::mutex mutex;
+    std::condition_variable not_empty;
+    std::condition_variable not_full;
+};
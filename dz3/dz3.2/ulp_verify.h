@@ -0,0 +1,248 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <limits>
+#include <ostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+#include "result_format.h"
+
+// Проверка результатов в ULP (единицах последнего разряда double) относительно эталона
+// в long double. На x86 у long double 64 бита мантиссы, то есть на 11 бит больше, чем
+// у double, и sinl/sqrtl/powl точнее проверяемых функций на три порядка.
+//
+// Ошибки копятся в гистограммах по операциям и по диапазонам аргумента (двоичным порядкам
+// |arg1|), строка проходит или нет по выбранной политике допусков.
+
+constexpr size_t RESULT_OP_COUNT = static_cast<size_t>(ResultOp::Count);
+
+inline long double reference_value(ResultOp op, long double arg1, long double arg2) {
+    switch (op) {
+        case ResultOp::Sin: return sinl(arg1);
+        case ResultOp::Sqrt: return sqrtl(arg1);
+        case ResultOp::Pow: return powl(arg1, arg2);
+        default: throw std::runtime_error("Unknown operation code");
+    }
+}
+
+// То же значение в double через libm - то, что считает сервер
+inline double libm_value(ResultOp op, double arg1, double arg2) {
+    switch (op) {
+        case ResultOp::Sin: return std::sin(arg1);
+        case ResultOp::Sqrt: return std::sqrt(arg1);
+        case ResultOp::Pow: return std::pow(arg1, arg2);
+        default: throw std::runtime_error("Unknown operation code");
+    }
+}
+
+// |result - reference| в ULP double в точке reference. NaN против NaN и совпадающие
+// бесконечности - ноль, прочие расхождения с NaN и бесконечностью - бесконечность
+inline double ulp_error(double result, long double reference) {
+    if (std::isnan(reference) || std::isnan(result))
+        return std::isnan(reference) && std::isnan(result) ? 0.0 : std::numeric_limits<double>::infinity();
+    if (std::isinf(reference) || std::isinf(result))
+        return static_cast<long double>(result) == reference ? 0.0 : std::numeric_limits<double>::infinity();
+    // reference = m * 2^e, 0.5 <= |m| < 1, ULP double = 2^(e - 53), у денормалов 2^-1074
+    int e = 0;
+    if (reference != 0) std::frexp(reference, &e);
+    int ulp_exp = reference != 0 ? std::max(e - 53, -1074) : -1074;
+    return static_cast<double>(std::fabs(std::ldexp(static_cast<long double>(result) - reference, -ulp_exp)));
+}
+
+// Прежняя проверка текстовых файлов: относительная погрешность для |x| >= 1, абсолютная для меньших
+inline bool within_mixed(double expected, double result, double eps) {
+    double max_value = std::max(std::fabs(expected), std::fabs(result));
+    double diff = std::fabs(expected - result);
+    double error = max_value >= 1 ? diff / max_value : diff;
+    return error <= eps;
+}
+
+// Строка проходит, если ошибка не больше max_ulps ULP своей операции. Для текстовых
+// файлов, где числа округлены до 6 знаков, вместо ULP задается mixed_eps. При same_bits
+// результат должен совпасть с libm_value бит в бит
+struct TolerancePolicy {
+    std::string name;
+    double max_ulps[RESULT_OP_COUNT];
+    double mixed_eps = 0.0;
+    bool same_bits = false;
+};
+
+// bits - совпадение с libm этой машины бит в бит (по умолчанию для двоичных файлов),
+// exact - корректное округление, libm - точность glibc, simd - векторные функции libmvec,
+// float - вычисления в одинарной точности (1 ULP float = 2^29 ULP double)
+inline TolerancePolicy make_policy(const std::string& name) {
+    if (name == "bits") return {name, {0, 0, 0}, 0.0, true};
+    if (name == "exact") return {name, {0.5, 0.5, 0.5}};
+    if (name == "libm") return {name, {1, 0.5, 1}};
+    if (name == "simd") return {name, {4, 0.5, 4}};
+    if (name == "float") return {name, {1 << 29, 1 << 29, 1 << 29}};
+    if (name == "text") return {name, {0, 0, 0}, 1e-5};
+    throw std::runtime_error("Unknown tolerance policy: " + name);
+}
+
+// "sin=4,pow=8": переопределяет допуск в ULP для отдельных операций
+inline void set_ulp_limits(TolerancePolicy& policy, const std::string& limits) {
+    std::stringstream ss(limits);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        auto eq = item.find('=');
+        std::string name = item.substr(0, eq);
+        bool found = false;
+        for (size_t k = 0; k < RESULT_OP_COUNT; ++k) {
+            if (name == result_op_name(static_cast<ResultOp>(k))) {
+                policy.max_ulps[k] = eq == std::string::npos ? 0.5 : std::atof(item.c_str() + eq + 1);
+                found = true;
+            }
+        }
+        if (!found)
+            throw std::runtime_error("Unknown operation in ULP limits: " + name);
+    }
+    policy.mixed_eps = 0.0;
+    policy.same_bits = false;
+    policy.name += "+" + limits;
+}
+
+class UlpVerifier {
+public:
+    // Границы корзин: 0, (0, 0.5], (0.5, 1], (1, 2], ..., (2^40, 2^41], дальше - все остальное
+    static constexpr size_t ULP_BUCKETS = 45;
+    // Диапазоны аргумента: 0, (0, 1), [1, 2), [2, 4), ..., [2^15, 2^16), дальше - все остальное
+    static constexpr size_t ARG_RANGES = 19;
+
+    explicit UlpVerifier(TolerancePolicy policy) : policy(std::move(policy)) {}
+
+    // Возвращает true, если строка укладывается в допуск
+    bool add(ResultOp op, double arg1, double arg2, double result) {
+        long double reference = reference_value(op, arg1, arg2);
+        double ulps = ulp_error(result, reference);
+        size_t k = static_cast<size_t>(op);
+        bool ok = policy.same_bits
+            ? std::bit_cast<uint64_t>(result) == std::bit_cast<uint64_t>(libm_value(op, arg1, arg2))
+            : policy.mixed_eps > 0
+            ? within_mixed(static_cast<double>(reference), result, policy.mixed_eps)
+            : ulps <= policy.max_ulps[k];
+        per_op[k].add(ulps, ok, arg1, arg2);
+        per_range[k][arg_range(arg1)].add(ulps, ok, arg1, arg2);
+        return ok;
+    }
+
+    void merge(const UlpVerifier& other) {
+        for (size_t k = 0; k < RESULT_OP_COUNT; ++k) {
+            per_op[k].merge(other.per_op[k]);
+            for (size_t r = 0; r < ARG_RANGES; ++r)
+                per_range[k][r].merge(other.per_range[k][r]);
+        }
+    }
+
+    size_t count() const {
+        size_t n = 0;
+        for (const auto& s : per_op) n += s.count;
+        return n;
+    }
+
+    size_t failed() const {
+        size_t n = 0;
+        for (const auto& s : per_op) n += s.failed;
+        return n;
+    }
+
+    void report(std::ostream& out) const {
+        out << "policy " << policy.name;
+        if (std::numeric_limits<long double>::digits <= std::numeric_limits<double>::digits)
+            out << " (warning: long double is not wider than double, reference is not exact)";
+        out << "\n";
+        for (size_t k = 0; k < RESULT_OP_COUNT; ++k) {
+            const Stats& s = per_op[k];
+            if (s.count == 0) continue;
+            out << "  " << result_op_name(static_cast<ResultOp>(k)) << ": n=" << s.count
+                << " failed=" << s.failed << " mean=" << s.sum_ulps / s.count << " ulp max=" << s.max_ulps
+                << " ulp at (" << s.worst_arg1 << ", " << s.worst_arg2 << ")\n    ulps:";
+            for (size_t b = 0; b < ULP_BUCKETS; ++b) {
+                if (s.hist[b] == 0) continue;
+                out << " " << bucket_name(b) << ":" << s.hist[b];
+            }
+            out << "\n";
+            for (size_t r = 0; r < ARG_RANGES; ++r) {
+                const Stats& rs = per_range[k][r];
+                if (rs.count == 0) continue;
+                out << "    arg " << range_name(r) << ": n=" << rs.count << " failed=" << rs.failed
+                    << " mean=" << rs.sum_ulps / rs.count << " max=" << rs.max_ulps << "\n";
+            }
+        }
+    }
+
+private:
+    struct Stats {
+        size_t count = 0;
+        size_t failed = 0;
+        double sum_ulps = 0.0;
+        double max_ulps = -1.0;
+        double worst_arg1 = 0.0;
+        double worst_arg2 = 0.0;
+        size_t hist[ULP_BUCKETS] = {};
+
+        void add(double ulps, bool ok, double arg1, double arg2) {
+            ++count;
+            failed += !ok;
+            if (std::isfinite(ulps)) sum_ulps += ulps;
+            if (ulps > max_ulps) {
+                max_ulps = ulps;
+                worst_arg1 = arg1;
+                worst_arg2 = arg2;
+            }
+            ++hist[ulp_bucket(ulps)];
+        }
+
+        void merge(const Stats& other) {
+            count += other.count;
+            failed += other.failed;
+            sum_ulps += other.sum_ulps;
+            if (other.max_ulps > max_ulps) {
+                max_ulps = other.max_ulps;
+                worst_arg1 = other.worst_arg1;
+                worst_arg2 = other.worst_arg2;
+            }
+            for (size_t b = 0; b < ULP_BUCKETS; ++b)
+                hist[b] += other.hist[b];
+        }
+    };
+
+    static size_t ulp_bucket(double ulps) {
+        if (ulps == 0) return 0;
+        if (ulps <= 0.5) return 1;
+        if (!(ulps <= std::ldexp(1.0, ULP_BUCKETS - 4))) return ULP_BUCKETS - 1;
+        return static_cast<size_t>(std::ceil(std::log2(ulps))) + 2;
+    }
+
+    static std::string bucket_name(size_t b) {
+        if (b == 0) return "0";
+        if (b == ULP_BUCKETS - 1) return ">2^" + std::to_string(ULP_BUCKETS - 4);
+        if (b == 1) return "<=0.5";
+        return "<=2^" + std::to_string(static_cast<int>(b) - 2);
+    }
+
+    static size_t arg_range(double arg) {
+        double a = std::fabs(arg);
+        if (a == 0) return 0;
+        if (a < 1) return 1;
+        if (!(a < std::ldexp(1.0, ARG_RANGES - 3))) return ARG_RANGES - 1;
+        return static_cast<size_t>(std::ilogb(a)) + 2;
+    }
+
+    static std::string range_name(size_t r) {
+        if (r == 0) return "0";
+        if (r == 1) return "(0,1)";
+        if (r == ARG_RANGES - 1) return ">=2^" + std::to_string(ARG_RANGES - 3);
+        return "[2^" + std::to_string(r - 2) + ",2^" + std::to_string(r - 1) + ")";
+    }
+
+    TolerancePolicy policy;
+    Stats per_op[RESULT_OP_COUNT];
+    Stats per_range[RESULT_OP_COUNT][ARG_RANGES];
+};